@@ -0,0 +1,354 @@
+/// Measures the costs of pine itself (the state stack, and the game loop)
+///
+/// Each benchmark is run several times, and the fastest run is reported as a
+/// line of JSON on stdout:
+///
+///     {"benchmark":"stack/push_pop","param":8,"iterations":100000,"ns_per_op":41.2}
+///
+/// Build with optimizations, e.g.
+///
+///     c++ -std=c++11 -O2 -pthread -I. benchmark.cpp -o pine_benchmark
+///
+/// Pass --quick to run fewer iterations.
+
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+#include <pine/Time.hpp>
+#include <pine/RunGame.hpp>
+#include <pine/Clock.hpp>
+#include <pine/FramePacer.hpp>
+#include <pine/LoopPolicy.hpp>
+#include <pine/StatedGame.hpp>
+#include <pine/StaticGameStateStack.hpp>
+#include <pine/TimerWheel.hpp>
+
+namespace
+{
+    std::size_t iterationScale = 10;
+
+    // keeps the optimizer from removing the benchmarked work
+    volatile std::uint64_t sink = 0;
+
+    const int RUN_COUNT = 5;
+
+    void report(const char* name, std::size_t param, std::size_t iterations, pine::Nanoseconds bestTime)
+    {
+        std::cout << "{\"benchmark\":\"" << name << "\",\"param\":" << param
+                  << ",\"iterations\":" << iterations
+                  << ",\"ns_per_op\":" << static_cast<double>(bestTime) / iterations << "}\n";
+    }
+
+    /// Runs f(iterations) RUN_COUNT times, and reports the fastest run
+    template <class F>
+    void benchmark(const char* name, std::size_t param, std::size_t iterations, F f)
+    {
+        pine::Nanoseconds bestTime = 0;
+        for(int run = 0; run < RUN_COUNT; ++run)
+        {
+            pine::Nanoseconds start = pine::time_now_ns();
+            f(iterations);
+            pine::Nanoseconds time = pine::time_now_ns() - start;
+
+            if(run == 0 || time < bestTime) bestTime = time;
+        }
+        report(name, param, iterations, bestTime);
+    }
+}
+
+struct BenchGame : pine::StatedGame<BenchGame>
+{
+    BenchGame() : tickLimit(0), tickCount(0) { }
+
+    void onConfigureEngine() { }
+    void onInit(int argc, char* argv[]) { }
+    void onFrameStart() { }
+    void onUpdate(pine::Seconds deltaTime)
+    {
+        if(++tickCount == tickLimit) quit(0);
+    }
+    void onFrameEnd(pine::Real interpolation) { }
+    void onWillQuit(int errorCode) { }
+
+    pine::Tick tickLimit;
+    pine::Tick tickCount;
+};
+
+struct BenchState : public BenchGame::State
+{
+private:
+
+    virtual void update(pine::Seconds deltaTime) override { sink = sink + 1; }
+    virtual void render(pine::Real interpolation) override { sink = sink + 1; }
+};
+
+// updated at a sixth of the tick rate, e.g. 10Hz at 60Hz
+struct LowRateBenchState : public BenchGame::State
+{
+private:
+
+    virtual pine::UpdateRate getUpdateRate() const override { return pine::UpdateRate::every(6); }
+    virtual void update(pine::Seconds deltaTime) override { sink = sink + 1; }
+};
+
+struct RollbackData
+{
+    std::uint64_t position[4];
+    std::uint64_t velocity[4];
+};
+
+struct RollbackBenchState : pine::RollbackGameState<BenchGame, RollbackData>
+{
+private:
+
+    virtual void update(pine::Seconds deltaTime) override
+    {
+        for(int i = 0; i < 4; ++i) getData().position[i] += getData().velocity[i] + 1;
+    }
+};
+
+struct CountingListener : pine::GameStateStackListener<BenchGame::StateStack>
+{
+private:
+
+    virtual void onGameStateWasPushed(BenchGame::StateStack& sender, BenchGame::State& gameState) override { sink = sink + 1; }
+    virtual void onStackWillBePopped(BenchGame::StateStack& sender) override { sink = sink + 1; }
+};
+
+struct StaticBenchState;
+using StaticBenchStack = pine::StaticGameStateStack<BenchGame, StaticBenchState>;
+
+struct StaticBenchState : pine::StaticGameState<BenchGame>
+{
+    void update(pine::Seconds deltaTime) { sink = sink + 1; }
+    void render(pine::Real interpolation) { sink = sink + 1; }
+};
+
+static void fill(BenchGame::StateStack& stack, std::size_t depth, pine::PushType pushType)
+{
+    for(std::size_t i = 0; i < depth; ++i)
+    {
+        stack.push(new BenchState, pushType);
+    }
+}
+
+static void benchmarkStackMutations()
+{
+    const std::size_t depths[] = { 1, 8, 64 };
+    for(std::size_t depth : depths)
+    {
+        benchmark("stack/push_pop", depth, 10000 * iterationScale, [depth](std::size_t iterations)
+        {
+            BenchGame game;
+            BenchGame::StateStack stack(game);
+            fill(stack, depth, pine::PushType::PushWithoutPopping);
+
+            for(std::size_t i = 0; i < iterations; ++i)
+            {
+                stack.push<BenchState>();
+                stack.pop();
+            }
+        });
+
+        benchmark("stack/push_remove", depth, 10000 * iterationScale, [depth](std::size_t iterations)
+        {
+            BenchGame game;
+            BenchGame::StateStack stack(game);
+            fill(stack, depth, pine::PushType::PushWithoutPopping);
+
+            for(std::size_t i = 0; i < iterations; ++i)
+            {
+                BenchState* state = new BenchState;
+                stack.push(state);
+                stack.remove(state);
+            }
+        });
+
+        // the state is found through its handle, rather than by searching the stack
+        benchmark("stack/push_remove_handle", depth, 10000 * iterationScale, [depth](std::size_t iterations)
+        {
+            BenchGame game;
+            BenchGame::StateStack stack(game);
+            fill(stack, depth, pine::PushType::PushWithoutPopping);
+
+            for(std::size_t i = 0; i < iterations; ++i)
+            {
+                stack.remove(stack.push<BenchState>());
+            }
+        });
+    }
+
+    const std::size_t listenerCounts[] = { 0, 1, 8 };
+    for(std::size_t listenerCount : listenerCounts)
+    {
+        benchmark("stack/push_pop_listeners", listenerCount, 10000 * iterationScale, [listenerCount](std::size_t iterations)
+        {
+            // the listeners must outlive the stack
+            std::vector<CountingListener> listeners(listenerCount);
+            BenchGame game;
+            BenchGame::StateStack stack(game);
+            for(auto& listener : listeners)
+            {
+                stack.addListener(&listener);
+            }
+            fill(stack, 1, pine::PushType::PushWithoutPopping);
+
+            for(std::size_t i = 0; i < iterations; ++i)
+            {
+                stack.push<BenchState>();
+                stack.pop();
+            }
+        });
+    }
+}
+
+static void benchmarkDispatch()
+{
+    const std::size_t depths[] = { 1, 8, 64, 512 };
+    for(std::size_t depth : depths)
+    {
+        // every state is updated and rendered, as they are pushed silently
+        benchmark("dispatch/virtual_update_render", depth, 1000 * iterationScale, [depth](std::size_t iterations)
+        {
+            BenchGame game;
+            BenchGame::StateStack stack(game);
+            fill(stack, depth, pine::PushType::PushWithoutPoppingSilenty);
+
+            for(std::size_t i = 0; i < iterations; ++i)
+            {
+                stack.update(1.0 / 60);
+                stack.render(0);
+            }
+        });
+
+        // the states are spread across the ticks, so a sixth of them are updated each tick
+        benchmark("dispatch/low_rate_update", depth, 1000 * iterationScale, [depth](std::size_t iterations)
+        {
+            BenchGame game;
+            BenchGame::StateStack stack(game);
+            for(std::size_t i = 0; i < depth; ++i)
+            {
+                stack.push(new LowRateBenchState, pine::PushType::PushWithoutPoppingSilenty);
+            }
+
+            for(std::size_t i = 0; i < iterations; ++i)
+            {
+                stack.update(1.0 / 60);
+            }
+        });
+
+        benchmark("dispatch/static_update_render", depth, 1000 * iterationScale, [depth](std::size_t iterations)
+        {
+            BenchGame game;
+            StaticBenchStack stack(game, depth);
+            for(std::size_t i = 0; i < depth; ++i)
+            {
+                stack.push<StaticBenchState, pine::PushType::PushWithoutPoppingSilenty>();
+            }
+
+            for(std::size_t i = 0; i < iterations; ++i)
+            {
+                stack.update(1.0 / 60);
+                stack.render(0);
+            }
+        });
+    }
+}
+
+static void benchmarkRollback()
+{
+    const std::size_t depths[] = { 1, 8, 64 };
+    for(std::size_t depth : depths)
+    {
+        // restoring a tick 8 ticks ago, and updating (and saving) the 8 ticks again
+        benchmark("rollback/rewind_resimulate_8", depth, 1000 * iterationScale, [depth](std::size_t iterations)
+        {
+            BenchGame game;
+            BenchGame::StateStack& stack = game.getStateStack();
+            stack.setRollbackWindow(16, depth * sizeof(RollbackData));
+            for(std::size_t i = 0; i < depth; ++i)
+            {
+                stack.push(new RollbackBenchState, pine::PushType::PushWithoutPoppingSilenty);
+            }
+            for(int i = 0; i < 8; ++i)
+            {
+                game.update(1.0 / 60);
+            }
+
+            for(std::size_t i = 0; i < iterations; ++i)
+            {
+                game.rollback(stack.getTick() - 8, 1.0 / 60);
+            }
+        });
+    }
+}
+
+static void benchmarkTimers()
+{
+    const std::size_t liveCounts[] = { 1000, 100000 };
+    for(std::size_t liveCount : liveCounts)
+    {
+        benchmark("timers/schedule_cancel", liveCount, 100000 * iterationScale, [liveCount](std::size_t iterations)
+        {
+            pine::TimerWheel timers;
+            for(std::size_t i = 0; i < liveCount; ++i)
+            {
+                timers.after(1 + i % 100000, [] { sink = sink + 1; });
+            }
+
+            for(std::size_t i = 0; i < iterations; ++i)
+            {
+                timers.cancel(timers.after(1 + i % 1000, [] { sink = sink + 1; }));
+            }
+        });
+
+        // each tick, about 1 in 600 of the timers fires and is rescheduled
+        benchmark("timers/advance", liveCount, 1000 * iterationScale, [liveCount](std::size_t iterations)
+        {
+            pine::TimerWheel timers;
+            for(std::size_t i = 0; i < liveCount; ++i)
+            {
+                timers.every(600 + i % 600, [] { sink = sink + 1; });
+            }
+
+            for(std::size_t i = 0; i < iterations; ++i)
+            {
+                timers.advance(1.0 / 60);
+            }
+        });
+    }
+}
+
+static void benchmarkLoop()
+{
+    // the cost of the game loop itself, per update, on a clock that never waits
+    benchmark("loop/fixed_time_step_tick", 60, 10000 * iterationScale, [](std::size_t iterations)
+    {
+        BenchGame game;
+        game.init(0, nullptr);
+        game.tickLimit = iterations;
+        game.getStateStack().push<BenchState>();
+
+        pine::VirtualClock clock;
+        pine::HybridFramePacer pacer;
+        pine::detail::RunGame<pine::FixedTimeStep<60> >(game, pacer, clock);
+    });
+}
+
+int main(int argc, char* argv[])
+{
+    for(int i = 1; i < argc; ++i)
+    {
+        if(std::strcmp(argv[i], "--quick") == 0) iterationScale = 1;
+    }
+
+    benchmarkStackMutations();
+    benchmarkDispatch();
+    benchmarkRollback();
+    benchmarkTimers();
+    benchmarkLoop();
+
+    return 0;
+}
@@ -31,7 +31,7 @@ struct MyGame : pine::StatedGame<MyGame, MyEngine>
     {
         std::cout << "--Game Update\n";
     }
-    void onFrameEnd() 
+    void onFrameEnd(pine::Real interpolation) 
     { 
         std::cout << "--Game Frame end\n";
         quit(1);
@@ -59,7 +59,7 @@ private:
     {
         std::cout << "---unloading resources in state\n";
     }
-    virtual void render() override
+    virtual void render(pine::Real interpolation) override
     { 
         std::cout << "---render frame in state\n";
     }
@@ -0,0 +1,109 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_CLOCK_HPP
+#define PINE_CLOCK_HPP
+
+#include <chrono>
+#include <thread>
+
+#include <cassert>
+
+#include <pine/Types.hpp>
+#include <pine/Time.hpp>
+
+/// \file
+/// Clocks are the time source of the game loop. A clock must provide:
+///
+/// - `Nanoseconds now() const`
+///     - the current (monotonic) time
+/// - `void sleepFor(Nanoseconds duration)`
+///     - gives up the CPU for (at least) the duration
+/// - `void spinUntil(Nanoseconds deadline)`
+///     - waits until the deadline without giving up the CPU
+
+namespace pine
+{
+    /// \brief The real clock, which is steady
+    class SystemClock
+    {
+    public:
+
+        Nanoseconds now() const { return time_now_ns(); }
+
+        void sleepFor(Nanoseconds duration)
+        {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(duration));
+        }
+
+        void spinUntil(Nanoseconds deadline)
+        {
+            while(now() < deadline) { }
+        }
+    };
+
+    /// \brief A clock that only advances when it is told to
+    ///
+    /// Waiting on a virtual clock returns immediately, having advanced
+    /// the clock to the end of the wait. Thus a game run with a virtual
+    /// clock runs as fast as the CPU allows, whilst seeing exactly the
+    /// same times it would in real time.
+    class VirtualClock
+    {
+    public:
+
+        /// \param startTime The time the clock starts at
+        explicit VirtualClock(Nanoseconds startTime = 0) :
+            _time(startTime)
+        {
+        }
+
+        Nanoseconds now() const { return _time; }
+
+        /// Advances the clock
+        /// \param duration The amount of time to advance by
+        void advance(Nanoseconds duration)
+        {
+            assert(duration >= 0 && "Cannot advance a clock backwards");
+            _time += duration;
+        }
+
+        void sleepFor(Nanoseconds duration) { advance(duration); }
+
+        void spinUntil(Nanoseconds deadline)
+        {
+            if(deadline > _time) _time = deadline;
+        }
+
+    private:
+
+        Nanoseconds _time;
+    };
+}
+
+#endif // PINE_CLOCK_HPP
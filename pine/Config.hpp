@@ -46,4 +46,8 @@
 /// boost::chrono instead of std::chrono
 //#define PINE_USE_BOOST_CHRONO
 
+/// Uncomment this macro, if you wish to record the time
+/// spent in the game loop with the profiler (see Profiler.hpp)
+//#define PINE_ENABLE_PROFILER
+
 #endif // PINE_CONFIG_HPP
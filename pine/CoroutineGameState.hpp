@@ -0,0 +1,334 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+
+#ifndef PINE_COROUTINE_GAME_STATE_HPP
+#define PINE_COROUTINE_GAME_STATE_HPP
+
+// coroutines require C++20, this header is empty without them
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#   if __has_include(<coroutine>)
+#       define PINE_HAS_COROUTINES 1
+#   endif
+#endif
+
+#ifndef PINE_HAS_COROUTINES
+#   define PINE_HAS_COROUTINES 0
+#endif
+
+#if PINE_HAS_COROUTINES
+
+#include <utility>
+#include <exception>
+#include <limits>
+#include <coroutine>
+
+#include <pine/Time.hpp>
+#include <pine/Types.hpp>
+#include <pine/GameState.hpp>
+#include <pine/GameStateStack.hpp>
+
+namespace pine
+{
+    /// \brief What a StateScript waits for before it is resumed
+    struct ScriptWait
+    {
+        enum class Type
+        {
+            /// The next update of the state
+            NextTick,
+
+            /// An amount of time the state has been updated for
+            Time,
+
+            /// A condition to be true, which is checked each update
+            Condition
+        };
+
+        /// \return true if the condition of the wait is true
+        bool isConditionTrue() const { return condition(context); }
+
+        Type type;
+        Nanoseconds duration;
+
+        /// The condition, and what it is checked with (which lives in the script's frame)
+        bool (*condition)(const void*);
+        const void* context;
+    };
+
+    /// \brief The coroutine that scripts a CoroutineGameState, see CoroutineGameState::run
+    class StateScript
+    {
+    public:
+
+        struct promise_type
+        {
+            StateScript get_return_object() { return StateScript(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() { }
+            void unhandled_exception() { error = std::current_exception(); }
+
+            /// What the script waits for, set each time it is suspended
+            ScriptWait wait;
+
+            /// The exception the script ended with, if any
+            std::exception_ptr error;
+        };
+
+        using Handle = std::coroutine_handle<promise_type>;
+
+        StateScript() = default;
+
+        StateScript(StateScript&& other) noexcept :
+            _handle(std::exchange(other._handle, nullptr))
+        {
+        }
+
+        StateScript& operator=(StateScript&& other) noexcept
+        {
+            if(this != &other)
+            {
+                if(_handle) _handle.destroy();
+                _handle = std::exchange(other._handle, nullptr);
+            }
+            return *this;
+        }
+
+        ~StateScript()
+        {
+            if(_handle) _handle.destroy();
+        }
+
+        /// \return true if the script has run to its end
+        bool isFinished() const { return !_handle || _handle.done(); }
+
+        /// Runs the script until it waits (or ends)
+        void resume()
+        {
+            _handle.resume();
+
+            // re-throws any exception the script ended with
+            if(_handle.promise().error) std::rethrow_exception(std::exchange(_handle.promise().error, nullptr));
+        }
+
+        /// \return What the script waits for
+        const ScriptWait& getWait() const { return _handle.promise().wait; }
+
+    private:
+
+        explicit StateScript(Handle handle) : _handle(handle) { }
+
+        Handle _handle = nullptr;
+    };
+
+    namespace detail
+    {
+        /// Suspends a StateScript until the next update, or until it has been updated for an amount of time
+        struct ScriptAwaiter
+        {
+            bool await_ready() const { return false; }
+
+            void await_suspend(StateScript::Handle handle)
+            {
+                handle.promise().wait = wait;
+            }
+
+            void await_resume() const { }
+
+            ScriptWait wait;
+        };
+
+        /// Suspends a StateScript until a condition is true, the condition is
+        /// kept in the awaiter, which lives in the script's frame whilst it waits
+        template <class TCondition>
+        struct ConditionAwaiter
+        {
+            static bool isTrue(const void* condition)
+            {
+                return (*static_cast<const TCondition*>(condition))();
+            }
+
+            bool await_ready() const { return condition(); }
+
+            void await_suspend(StateScript::Handle handle)
+            {
+                handle.promise().wait = ScriptWait{ScriptWait::Type::Condition, 0, &isTrue, &condition};
+            }
+
+            void await_resume() const { }
+
+            TCondition condition;
+        };
+    }
+
+    /// \brief A GameState that is scripted with a coroutine
+    /// \tparam TGame A game concept
+    ///
+    /// The state's run() coroutine is started the first time the state is
+    /// updated, and it is resumed by the state's update once what it waits for
+    /// is due:
+    ///
+    ///     StateScript run() override
+    ///     {
+    ///         showTitle();
+    ///         co_await seconds(2.5);
+    ///         co_await stateLoaded(level);
+    ///         getGame().getStateStack().remove(this);
+    ///     }
+    ///
+    /// Whilst the script waits for an amount of time (or once it has ended) the
+    /// state sleeps (see GameState::sleepFor), so the stack does not update it at
+    /// all until it is due. A condition is checked each time the state is updated,
+    /// and neither kind of wait allocates. As the script is only resumed when the
+    /// state is updated, it does not advance whilst the state is paused (or cached),
+    /// and seconds() counts the time the state has been updated for.
+    ///
+    /// \note update() is used to run the script, so it cannot be overridden
+    template <class TGame>
+    class CoroutineGameState : public GameState<TGame>
+    {
+    public:
+
+        using State = GameState<TGame>;
+
+        CoroutineGameState() :
+            _isStarted(false),
+            _elapsedTime(0),
+            _wakeTime(0)
+        {
+        }
+
+        /// \return true if the script has run to its end
+        bool isScriptFinished() const { return _isStarted && _script.isFinished(); }
+
+    protected:
+
+        /// \return The script of the state
+        virtual StateScript run() = 0;
+
+        /// Waits until the next update
+        static detail::ScriptAwaiter nextTick()
+        {
+            return detail::ScriptAwaiter{ScriptWait{ScriptWait::Type::NextTick, 0, nullptr, nullptr}};
+        }
+
+        /// Waits until the state has been updated for an amount of time, the state
+        /// is not updated whilst it waits
+        /// \param duration The time to wait for, in seconds
+        static detail::ScriptAwaiter seconds(Seconds duration)
+        {
+            return detail::ScriptAwaiter{ScriptWait{ScriptWait::Type::Time, to_nanoseconds(duration), nullptr, nullptr}};
+        }
+
+        /// Waits until a condition is true, which is checked on each update
+        /// \param condition The condition, a callable returning bool
+        template <class TCondition>
+        static detail::ConditionAwaiter<TCondition> until(TCondition condition)
+        {
+            return detail::ConditionAwaiter<TCondition>{std::move(condition)};
+        }
+
+        /// Waits until a GameState pushed asynchronously has finished loading, and is on the stack
+        /// (or until it is gone, if it failed to load or was removed)
+        /// \param handle The handle of the GameState, see GameStateStack::pushAsync
+        auto stateLoaded(GameStateHandle handle)
+        {
+            auto* stack = &this->getGame().getStateStack();
+            return until([stack, handle]() { return !stack->isAlive(handle) || stack->isOnStack(handle); });
+        }
+
+        /// \return The time the state has been updated for, in seconds
+        Seconds getElapsedTime() const { return to_seconds(_elapsedTime); }
+
+    private:
+
+        virtual void update(Seconds deltaTime) override final
+        {
+            _elapsedTime += to_nanoseconds(deltaTime);
+
+            if(!_isStarted)
+            {
+                _isStarted = true;
+                _script = run();
+                resume();
+                return;
+            }
+
+            if(_script.isFinished()) return;
+
+            const ScriptWait& wait = _script.getWait();
+            switch(wait.type)
+            {
+                case ScriptWait::Type::NextTick:
+                    break;
+                case ScriptWait::Type::Time:
+                    // woken a little early, by the rounding of the time slept for
+                    if(_elapsedTime < _wakeTime)
+                    {
+                        this->sleepFor(to_seconds(_wakeTime - _elapsedTime));
+                        return;
+                    }
+                    break;
+                case ScriptWait::Type::Condition:
+                    if(!wait.isConditionTrue()) return;
+                    break;
+            }
+
+            resume();
+        }
+
+        void resume()
+        {
+            _script.resume();
+
+            if(_script.isFinished())
+            {
+                this->sleepFor(std::numeric_limits<Seconds>::infinity());
+            }
+            else if(_script.getWait().type == ScriptWait::Type::Time)
+            {
+                _wakeTime = _elapsedTime + _script.getWait().duration;
+                this->sleepFor(to_seconds(_script.getWait().duration));
+            }
+        }
+
+        StateScript _script;
+        bool _isStarted;
+
+        /// The time the state has been updated for
+        Nanoseconds _elapsedTime;
+
+        /// When the script is resumed, if it waits for an amount of time
+        Nanoseconds _wakeTime;
+    };
+}
+
+#endif // PINE_HAS_COROUTINES
+
+#endif // PINE_COROUTINE_GAME_STATE_HPP
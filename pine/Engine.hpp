@@ -29,7 +29,13 @@
 #ifndef PINE_ENGINE_HPP
 #define PINE_ENGINE_HPP
 
-#include <pine/time.hpp>
+#include <memory>
+
+#include <cassert>
+
+#include <pine/Time.hpp>
+#include <pine/Profiler.hpp>
+#include <pine/JobSystem.hpp>
 
 namespace pine
 {
@@ -42,27 +48,37 @@ namespace pine
 
         Engine() :
             _errorState(0),
-            _hasShutdown(false)
+            _hasShutdown(false),
+            _jobThreadCount(ThreadPool::defaultThreadCount())
         {
         }
 
         void init(int argc, char* argv[])
         {
+            PINE_PROFILE_ZONE("Engine::init");
+            _jobSystem.reset(new JobSystem(_jobThreadCount));
             thisType()->onInit(argc, argv);
         }
 
         void frameStart()
         {
+            PINE_PROFILE_ZONE("Engine::frameStart");
             thisType()->onFrameStart();
         }
 
         void update(pine::Seconds deltaTime) 
         {
+            PINE_PROFILE_ZONE("Engine::update");
             thisType()->onUpdate(deltaTime);
         }
 
         void frameEnd() 
         {
+            PINE_PROFILE_ZONE("Engine::frameEnd");
+
+            // every job scheduled during the frame finishes within the frame
+            if(_jobSystem) _jobSystem->waitForFrame();
+
             thisType()->onFrameEnd();
         }
 
@@ -72,11 +88,39 @@ namespace pine
             _hasShutdown = true;
 
             static_cast<TEngine*>(this)->onShutdown();
+
+            // the job system is kept until the loop has exited (see releaseJobSystem), as the
+            // game may be shut down from its update, or from a job running on a worker thread
+        }
+
+        /// Finishes the scheduled jobs and joins the job system's threads, this is
+        /// called once the game loop has exited (see RunGame), or when the engine is destroyed
+        /// \note This must not be called from a job
+        void releaseJobSystem()
+        {
+            _jobSystem.reset();
         }
 
         int getErrorState() const { return _errorState; }
         bool hasShutdown() const { return _hasShutdown; }
 
+        /// \return The job system used to spread work across threads, which
+        ///         exists from init() until the game loop has exited (see releaseJobSystem)
+        JobSystem& getJobSystem()
+        {
+            assert(_jobSystem && "The engine has not been initialized");
+            return *_jobSystem;
+        }
+
+        /// Sets the amount of worker threads the job system is created with
+        /// \param threadCount The amount of threads, or 0 to run jobs on the threads that wait for them
+        /// \note This must be called before init()
+        void setJobThreadCount(std::size_t threadCount)
+        {
+            assert(!_jobSystem && "The job system has already been created");
+            _jobThreadCount = threadCount;
+        }
+
     private:
 
         TEngine* thisType() { return static_cast<TEngine*>(this); }
@@ -84,6 +128,12 @@ namespace pine
 
         int _errorState;
         bool _hasShutdown;
+
+        /// Schedules jobs on worker threads (created in init, destroyed in releaseJobSystem), the threads start with the first job
+        std::unique_ptr<JobSystem> _jobSystem;
+
+        /// The amount of threads the job system is created with
+        std::size_t _jobThreadCount;
     };
 }
 
@@ -0,0 +1,210 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+
+#ifndef PINE_EVENT_QUEUE_HPP
+#define PINE_EVENT_QUEUE_HPP
+
+#include <atomic>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+#include <pine/Time.hpp>
+#include <pine/Types.hpp>
+
+namespace pine
+{
+    /// \brief An event handed to the game from another thread (e.g. input, network or platform events)
+    ///
+    /// An event has a type, which is defined by your game, the time it was posted,
+    /// and up to DATA_SIZE bytes of trivially copyable data.
+    struct GameEvent
+    {
+        static const std::size_t DATA_SIZE = 48;
+
+        /// Constructs an event
+        /// \param type The type of the event, defined by your game
+        /// \param data The data of the event
+        /// \param time When the event happened (see time_now_ns)
+        template <class T>
+        static GameEvent make(std::uint32_t type, const T& data, Nanoseconds time = time_now_ns())
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "The data of an event must be trivially copyable");
+            static_assert(sizeof(T) <= DATA_SIZE, "The data of an event is too large");
+
+            GameEvent event;
+            event.type = type;
+            event.time = time;
+            std::memcpy(event.data, &data, sizeof(T));
+            return event;
+        }
+
+        /// \return The data of the event
+        template <class T>
+        T getData() const
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "The data of an event must be trivially copyable");
+            static_assert(sizeof(T) <= DATA_SIZE, "The data of an event is too large");
+
+            T value;
+            std::memcpy(&value, data, sizeof(T));
+            return value;
+        }
+
+        /// The type of the event, defined by your game
+        std::uint32_t type;
+
+        /// When the event happened
+        Nanoseconds time;
+
+        unsigned char data[DATA_SIZE];
+    };
+
+    /// \brief A lock-free queue of GameEvents, which any thread may post to,
+    ///        and which the thread running the game loop takes the events from
+    ///
+    /// The queue is a bounded ring: posting an event claims a cell with a single
+    /// compare-and-swap, and never allocates or blocks. When the queue is full,
+    /// the event is dropped (see getDroppedCount()).
+    class EventQueue
+    {
+    public:
+
+        /// \param capacity The most events the queue holds, rounded up to a power of two
+        explicit EventQueue(std::size_t capacity = 256) :
+            _postPosition(0),
+            _takePosition(0),
+            _droppedCount(0)
+        {
+            std::size_t size = 2;
+            while(size < capacity) size *= 2;
+
+            _cells.reset(new Cell[size]);
+            _mask = size - 1;
+            for(std::size_t i = 0; i < size; ++i)
+            {
+                _cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        EventQueue(const EventQueue&) = delete;
+        EventQueue& operator=(const EventQueue&) = delete;
+
+        /// Posts an event, this may be called from any thread
+        /// \return false if the queue was full, and the event was dropped
+        bool post(const GameEvent& event)
+        {
+            std::size_t position = _postPosition.load(std::memory_order_relaxed);
+            Cell* cell;
+            for(;;)
+            {
+                cell = &_cells[position & _mask];
+                std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+                if(difference == 0)
+                {
+                    if(_postPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+                }
+                else if(difference < 0)
+                {
+                    _droppedCount.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                {
+                    position = _postPosition.load(std::memory_order_relaxed);
+                }
+            }
+
+            cell->event = event;
+            cell->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Posts an event that happened now, this may be called from any thread
+        /// \param type The type of the event, defined by your game
+        /// \param data The data of the event
+        /// \return false if the queue was full, and the event was dropped
+        template <class T>
+        bool post(std::uint32_t type, const T& data)
+        {
+            return post(GameEvent::make(type, data));
+        }
+
+        /// Takes the oldest event from the queue, this may only be called from the thread running the game loop
+        /// \return false if the queue is empty
+        bool take(GameEvent& event)
+        {
+            Cell& cell = _cells[_takePosition & _mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if(sequence != _takePosition + 1) return false;
+
+            event = cell.event;
+            cell.sequence.store(_takePosition + _mask + 1, std::memory_order_release);
+            ++_takePosition;
+            return true;
+        }
+
+        /// \return The amount of events posted and not taken yet, this may only be called from the
+        ///         thread running the game loop (an event still being posted may be counted,
+        ///         but not be ready to take)
+        std::size_t getPendingCount() const { return _postPosition.load(std::memory_order_acquire) - _takePosition; }
+
+        /// \return The most events the queue holds
+        std::size_t getCapacity() const { return _mask + 1; }
+
+        /// \return The amount of events that were dropped as the queue was full
+        std::size_t getDroppedCount() const { return _droppedCount.load(std::memory_order_relaxed); }
+
+    private:
+
+        struct Cell
+        {
+            std::atomic<std::size_t> sequence;
+            GameEvent event;
+        };
+
+        std::unique_ptr<Cell[]> _cells;
+        std::size_t _mask;
+
+        // the positions are kept apart, so that posting and taking do not contend for a cache line
+        char _padding0[64];
+        std::atomic<std::size_t> _postPosition;
+        char _padding1[64];
+        std::size_t _takePosition;
+        char _padding2[64];
+
+        std::atomic<std::size_t> _droppedCount;
+    };
+}
+
+#endif // PINE_EVENT_QUEUE_HPP
@@ -0,0 +1,313 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+
+#ifndef PINE_FRAME_ALLOCATOR_HPP
+#define PINE_FRAME_ALLOCATOR_HPP
+
+#include <new>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include <cassert>
+
+namespace pine
+{
+    /// \brief Statistics on a FrameAllocator
+    struct FrameAllocatorStats
+    {
+        FrameAllocatorStats() :
+            frameCount(0),
+            allocationCount(0),
+            lastFrameBytes(0),
+            peakFrameBytes(0),
+            overflowCount(0),
+            growCount(0)
+        {
+        }
+
+        /// The amount of frames the allocator has been reset for
+        std::size_t frameCount;
+
+        /// The total amount of allocations
+        std::size_t allocationCount;
+
+        /// The amount of bytes allocated in the last frame
+        std::size_t lastFrameBytes;
+
+        /// The most bytes allocated in a frame (the high watermark)
+        std::size_t peakFrameBytes;
+
+        /// The amount of allocations that did not fit in the buffer,
+        /// and had to be allocated from the heap instead
+        std::size_t overflowCount;
+
+        /// The amount of times the buffer has been grown
+        std::size_t growCount;
+    };
+
+    /// \brief Allocates memory that lives until the end of a frame
+    ///
+    /// Allocating is a matter of bumping a pointer, and nothing is freed on its
+    /// own: the whole buffer is reset at once at the start of the next frame
+    /// (see Game::getFrameAllocator). The buffer is allocated on first use; when
+    /// a frame needs more memory than it holds, the rest is allocated from the
+    /// heap, and the buffer is grown to the high watermark when it is reset.
+    ///
+    /// \note A FrameAllocator may only be used from the thread running the game loop,
+    ///       and destructors of the objects allocated with it are never called
+    class FrameAllocator
+    {
+    public:
+
+        /// \param capacity The initial size of the buffer, in bytes
+        explicit FrameAllocator(std::size_t capacity = 64 * 1024) :
+            _capacity(capacity),
+            _top(0),
+            _overflowBytes(0)
+        {
+        }
+
+        FrameAllocator(const FrameAllocator&) = delete;
+        FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+        /// Allocates memory that lives until the allocator is reset
+        /// \param size The size of the memory, in bytes
+        /// \param alignment The alignment of the memory
+        /// \return The allocated memory (never null)
+        void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t))
+        {
+            if(!_buffer) _buffer.reset(new unsigned char[_capacity]);
+
+            std::uintptr_t base = reinterpret_cast<std::uintptr_t>(_buffer.get());
+            std::uintptr_t aligned = (base + _top + alignment - 1) / alignment * alignment;
+            std::size_t offset = static_cast<std::size_t>(aligned - base);
+
+            ++_stats.allocationCount;
+
+            if(offset + size > _capacity)
+            {
+                return allocateOverflow(size, alignment);
+            }
+
+            _top = offset + size;
+            return _buffer.get() + offset;
+        }
+
+        /// Allocates an array, which is not initialized
+        /// \param count The amount of elements
+        template <class T>
+        T* allocateArray(std::size_t count)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "Objects allocated with a FrameAllocator are never destroyed");
+            return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+        }
+
+        /// Constructs an object that lives until the allocator is reset
+        /// \param args The arguments to construct the object with
+        template <class T, class... Args>
+        T* make(Args&&... args)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "Objects allocated with a FrameAllocator are never destroyed");
+            return new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        /// Frees everything that has been allocated, this is called at the start of each frame
+        void reset()
+        {
+            std::size_t frameBytes = getUsedBytes();
+
+            ++_stats.frameCount;
+            _stats.lastFrameBytes = frameBytes;
+            if(frameBytes > _stats.peakFrameBytes) _stats.peakFrameBytes = frameBytes;
+
+            if(!_overflow.empty())
+            {
+                _overflow.clear();
+
+                // grows to the high watermark, so that a frame like this one fits next time
+                _capacity = _stats.peakFrameBytes + _stats.peakFrameBytes / 2;
+                _buffer.reset();
+                ++_stats.growCount;
+            }
+
+            _top = 0;
+            _overflowBytes = 0;
+        }
+
+        /// \return The amount of bytes allocated since the allocator was reset
+        std::size_t getUsedBytes() const { return _top + _overflowBytes; }
+
+        /// \return The size of the buffer, in bytes
+        std::size_t getCapacity() const { return _capacity; }
+
+        /// \return Statistics on the allocator
+        const FrameAllocatorStats& getStats() const { return _stats; }
+
+    private:
+
+        void* allocateOverflow(std::size_t size, std::size_t alignment)
+        {
+            ++_stats.overflowCount;
+            _overflowBytes += size;
+
+            _overflow.emplace_back(new unsigned char[size + alignment]);
+            std::uintptr_t base = reinterpret_cast<std::uintptr_t>(_overflow.back().get());
+            return reinterpret_cast<void*>((base + alignment - 1) / alignment * alignment);
+        }
+
+        std::unique_ptr<unsigned char[]> _buffer;
+        std::size_t _capacity;
+
+        /// The offset of the top of the buffer
+        std::size_t _top;
+
+        /// Allocations that did not fit in the buffer, freed when the allocator is reset
+        std::vector<std::unique_ptr<unsigned char[]> > _overflow;
+        std::size_t _overflowBytes;
+
+        FrameAllocatorStats _stats;
+    };
+
+    /// \brief Allocates memory that lives until the end of the next frame
+    ///
+    /// Holds two FrameAllocators, and alternates between them each frame, so that
+    /// what is allocated in one frame may still be used in the next (e.g. data built
+    /// in update() that is read by the next frame's render()).
+    ///
+    /// \note The memory must not be handed to the render thread of RunPipelinedGame,
+    ///       which may still be rendering a frame once the simulation is two frames
+    ///       ahead of it; copy what the render thread needs into a SnapshotBuffer instead
+    class DoubleFrameAllocator
+    {
+    public:
+
+        /// \param capacity The initial size of each buffer, in bytes
+        explicit DoubleFrameAllocator(std::size_t capacity = 64 * 1024) :
+            _allocators{ FrameAllocatorPtr(new FrameAllocator(capacity)), FrameAllocatorPtr(new FrameAllocator(capacity)) },
+            _current(0)
+        {
+        }
+
+        /// Allocates memory that lives until the end of the next frame
+        /// \param size The size of the memory, in bytes
+        /// \param alignment The alignment of the memory
+        void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t))
+        {
+            return getCurrent().allocate(size, alignment);
+        }
+
+        template <class T>
+        T* allocateArray(std::size_t count)
+        {
+            return getCurrent().allocateArray<T>(count);
+        }
+
+        template <class T, class... Args>
+        T* make(Args&&... args)
+        {
+            return getCurrent().make<T>(std::forward<Args>(args)...);
+        }
+
+        /// Switches to the other allocator, freeing what it allocated two frames ago;
+        /// this is called at the start of each frame
+        void swap()
+        {
+            _current = 1 - _current;
+            _allocators[_current]->reset();
+        }
+
+        /// \return The allocator used in this frame
+        FrameAllocator& getCurrent() { return *_allocators[_current]; }
+
+        /// \return The allocator used in the previous frame
+        FrameAllocator& getPrevious() { return *_allocators[1 - _current]; }
+
+    private:
+
+        typedef std::unique_ptr<FrameAllocator> FrameAllocatorPtr;
+
+        FrameAllocatorPtr _allocators[2];
+        std::size_t _current;
+    };
+
+    /// \brief Adapts a FrameAllocator to the standard library's allocator requirements
+    ///
+    /// Memory given back to the adapter is not freed until the FrameAllocator is
+    /// reset, so a container using it must not outlive the frame.
+    template <class T>
+    class FrameAllocatorAdapter
+    {
+    public:
+
+        using value_type = T;
+
+        // not explicit, so that a container may be constructed with the FrameAllocator itself
+        FrameAllocatorAdapter(FrameAllocator& allocator) :
+            _allocator(&allocator)
+        {
+        }
+
+        template <class U>
+        FrameAllocatorAdapter(const FrameAllocatorAdapter<U>& other) :
+            _allocator(other.getAllocator())
+        {
+        }
+
+        T* allocate(std::size_t count)
+        {
+            return static_cast<T*>(_allocator->allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T* memory, std::size_t count) { }
+
+        FrameAllocator* getAllocator() const { return _allocator; }
+
+    private:
+
+        FrameAllocator* _allocator;
+    };
+
+    template <class T, class U>
+    bool operator==(const FrameAllocatorAdapter<T>& lhs, const FrameAllocatorAdapter<U>& rhs)
+    { return lhs.getAllocator() == rhs.getAllocator(); }
+
+    template <class T, class U>
+    bool operator!=(const FrameAllocatorAdapter<T>& lhs, const FrameAllocatorAdapter<U>& rhs)
+    { return !(lhs == rhs); }
+
+    /// A vector that allocates from a FrameAllocator, e.g. FrameVector<Entity*> visible(getGame().getFrameAllocator());
+    template <class T>
+    using FrameVector = std::vector<T, FrameAllocatorAdapter<T> >;
+}
+
+#endif // PINE_FRAME_ALLOCATOR_HPP
@@ -0,0 +1,292 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_FRAME_PACER_HPP
+#define PINE_FRAME_PACER_HPP
+
+#include <cmath>
+#include <cstddef>
+
+#include <cassert>
+
+#include <pine/Types.hpp>
+#include <pine/Time.hpp>
+
+namespace pine
+{
+    /// \brief Statistics on how a frame pacer has waited
+    struct FramePacingStats
+    {
+        FramePacingStats() :
+            sleepTime(0),
+            spinTime(0),
+            frameCount(0)
+        {
+        }
+
+        /// Resets the statistics
+        void reset() { *this = FramePacingStats(); }
+
+        /// The total time spent sleeping (the CPU is free for other work)
+        Nanoseconds sleepTime;
+
+        /// The total time spent spinning (the CPU is busy)
+        Nanoseconds spinTime;
+
+        /// The amount of frames that have been paced
+        std::size_t frameCount;
+    };
+
+    namespace detail
+    {
+        /// \brief Waits until a deadline, by sleeping then spinning
+        ///
+        /// The thread sleeps in small intervals whilst there is enough time left
+        /// that a sleep will not overshoot the deadline, then spins for the remaining
+        /// time. How long a sleep takes is estimated from previous sleeps, so that
+        /// the deadline is met with sub-millisecond accuracy whilst spinning as
+        /// little as possible.
+        class HybridWaiter
+        {
+        public:
+
+            HybridWaiter() :
+                _estimate(sleepInterval()),
+                _mean(sleepInterval()),
+                _m2(0),
+                _sampleCount(1)
+            {
+            }
+
+            /// Waits until the deadline is reached
+            /// \param clock The clock to wait on
+            /// \param deadline The time to wait until (relative to the clock)
+            /// \param stats The statistics to record the wait in
+            template <class TClock>
+            void waitUntil(TClock& clock, Nanoseconds deadline, FramePacingStats& stats)
+            {
+                Nanoseconds now = clock.now();
+
+                while(deadline - now > _estimate)
+                {
+                    clock.sleepFor(sleepInterval());
+
+                    Nanoseconds newNow = clock.now();
+                    Nanoseconds observed = newNow - now;
+                    now = newNow;
+
+                    stats.sleepTime += observed;
+                    addSample(observed);
+                }
+
+                clock.spinUntil(deadline);
+                stats.spinTime += clock.now() - now;
+            }
+
+        private:
+
+            /// \return The interval of time slept for at once
+            static constexpr Nanoseconds sleepInterval() { return 1000000; }
+
+            // keeps a running mean and standard deviation of
+            // how long a sleep takes (Welford's algorithm)
+            void addSample(Nanoseconds sample)
+            {
+                double observed = static_cast<double>(sample);
+
+                // cap the samples so that the estimate adapts to changes in the scheduler
+                if(_sampleCount >= MAX_SAMPLE_COUNT)
+                {
+                    _sampleCount /= 2;
+                    _m2 /= 2;
+                }
+
+                ++_sampleCount;
+                double delta = observed - _mean;
+                _mean += delta / _sampleCount;
+                _m2 += delta * (observed - _mean);
+
+                double standardDeviation = std::sqrt(_m2 / (_sampleCount - 1));
+                _estimate = static_cast<Nanoseconds>(_mean + standardDeviation);
+            }
+
+            static constexpr std::size_t MAX_SAMPLE_COUNT = 1000;
+
+            /// The estimated (pessimistic) time that a sleep takes
+            Nanoseconds _estimate;
+
+            double _mean;
+            double _m2;
+            std::size_t _sampleCount;
+        };
+    }
+
+    /// \brief Does not wait at all between frames
+    ///
+    /// The game loop runs as fast as it possibly can, using
+    /// an entire core. Use this if you need the lowest latency
+    /// possible, or if something else (e.g. v-sync) limits the
+    /// frame rate.
+    class UncappedFramePacer
+    {
+    public:
+
+        /// Paces a frame
+        /// \param clock The clock the game loop runs on
+        /// \param frameStartTime The time that the frame started
+        /// \param nextTickTime The time that the next update of the game is due
+        template <class TClock>
+        void pace(TClock& clock, Nanoseconds frameStartTime, Nanoseconds nextTickTime)
+        {
+            ++_stats.frameCount;
+        }
+
+        /// \return The statistics on how the pacer has waited
+        const FramePacingStats& getStats() const { return _stats; }
+
+        /// Resets the statistics on how the pacer has waited
+        void resetStats() { _stats.reset(); }
+
+    private:
+
+        FramePacingStats _stats;
+    };
+
+    /// \brief Waits until the next update of the game is due
+    ///
+    /// The thread sleeps until just before the next update is due,
+    /// then spins until it is due. Frames are only ran when there is
+    /// an update to perform, thus the frame rate matches the tick rate
+    /// of the game.
+    class HybridFramePacer
+    {
+    public:
+
+        /// Paces a frame
+        /// \param clock The clock the game loop runs on
+        /// \param frameStartTime The time that the frame started
+        /// \param nextTickTime The time that the next update of the game is due
+        template <class TClock>
+        void pace(TClock& clock, Nanoseconds frameStartTime, Nanoseconds nextTickTime)
+        {
+            ++_stats.frameCount;
+            _waiter.waitUntil(clock, nextTickTime, _stats);
+        }
+
+        /// \return The statistics on how the pacer has waited
+        const FramePacingStats& getStats() const { return _stats; }
+
+        /// Resets the statistics on how the pacer has waited
+        void resetStats() { _stats.reset(); }
+
+    private:
+
+        FramePacingStats _stats;
+        detail::HybridWaiter _waiter;
+    };
+
+    /// \brief Limits the game loop to a target frame rate
+    ///
+    /// Frames are started at a constant rate, regardless of
+    /// when the next update of the game is due. If a frame takes
+    /// longer than the frame period, the next frame starts immediately.
+    class TargetFrameRateFramePacer
+    {
+    public:
+
+        /// \param framesPerSecond The frame rate to target
+        explicit TargetFrameRateFramePacer(FramesPerSecond framesPerSecond = 60) :
+            _nextFrameTime(0),
+            _remainder(0)
+        {
+            setTargetFrameRate(framesPerSecond);
+        }
+
+        /// Paces a frame
+        /// \param clock The clock the game loop runs on
+        /// \param frameStartTime The time that the frame started
+        /// \param nextTickTime The time that the next update of the game is due
+        template <class TClock>
+        void pace(TClock& clock, Nanoseconds frameStartTime, Nanoseconds nextTickTime)
+        {
+            ++_stats.frameCount;
+
+            // the frame period is kept as a fraction of a second,
+            // so that frames are started at exactly the frame rate
+            _nextFrameTime += NANOSECONDS_PER_SECOND / _framesPerSecond;
+            _remainder += NANOSECONDS_PER_SECOND % _framesPerSecond;
+            if(_remainder >= _framesPerSecond)
+            {
+                _remainder -= _framesPerSecond;
+                ++_nextFrameTime;
+            }
+
+            // if we have fallen behind, don't try to catch up
+            if(_nextFrameTime < frameStartTime)
+            {
+                _nextFrameTime = frameStartTime + NANOSECONDS_PER_SECOND / _framesPerSecond;
+                _remainder = 0;
+            }
+
+            _waiter.waitUntil(clock, _nextFrameTime, _stats);
+        }
+
+        /// Sets the frame rate to target
+        /// \param framesPerSecond The frame rate
+        void setTargetFrameRate(FramesPerSecond framesPerSecond)
+        {
+            assert(framesPerSecond > 0 && "Target frame rate must be positive");
+            _framesPerSecond = framesPerSecond;
+        }
+
+        /// \return The frame rate that is targeted
+        FramesPerSecond getTargetFrameRate() const { return _framesPerSecond; }
+
+        /// \return The statistics on how the pacer has waited
+        const FramePacingStats& getStats() const { return _stats; }
+
+        /// Resets the statistics on how the pacer has waited
+        void resetStats() { _stats.reset(); }
+
+    private:
+
+        FramePacingStats _stats;
+        detail::HybridWaiter _waiter;
+
+        /// The frame rate that is targeted
+        FramesPerSecond _framesPerSecond;
+
+        /// The time the next frame is due
+        Nanoseconds _nextFrameTime;
+
+        /// The fraction of a nanosecond the next frame is due after _nextFrameTime, in 1 / _framesPerSecond
+        Nanoseconds _remainder;
+    };
+}
+
+#endif // PINE_FRAME_PACER_HPP
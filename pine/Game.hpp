@@ -30,8 +30,15 @@
 #define PINE_GAME_HPP
 
 #include <cassert>
+#include <type_traits>
 
-#include <pine/time.hpp>
+#include <pine/Time.hpp>
+#include <pine/Profiler.hpp>
+#include <pine/GameLoad.hpp>
+#include <pine/TickLog.hpp>
+#include <pine/FrameAllocator.hpp>
+#include <pine/TimerWheel.hpp>
+#include <pine/EventQueue.hpp>
 
 namespace pine
 {
@@ -48,7 +55,7 @@ namespace pine
 
             using Engine = TEngine;
 
-            GameWithEngine() : _engine(nullptr) { }
+            GameWithEngine() : _engine(nullptr), _tickLog(nullptr), _isResimulating(false) { }
 
             void configureEngine()
             {
@@ -66,24 +73,41 @@ namespace pine
             {
                 getEngine().init(argc, argv);
                 if(!isRunning()) return;
+
+                PINE_PROFILE_ZONE("Game::init");
                 thisType()->onInit(argc, argv);
             }
 
             void frameStart()
             { 
                 getEngine().frameStart();
+
+                PINE_PROFILE_ZONE("Game::frameStart");
+                _frameAllocator.reset();
+                _twoFrameAllocator.swap();
                 thisType()->onFrameStart();
             }
 
             void update(Seconds deltaTime)
             {
                 getEngine().update(deltaTime);
+
+                PINE_PROFILE_ZONE("Game::update");
+                if(_tickLog && !_isResimulating) _tickLog->beginTick(deltaTime);
                 thisType()->onUpdate(deltaTime);
+                _timers.advance(deltaTime);
             }
 
-            void frameEnd()
+            /// Ends a frame
+            /// \param interpolation How far the game is between its previous
+            ///        and its next update, in the range [0, 1)
+            void frameEnd(Real interpolation)
             {
-                thisType()->onFrameEnd();
+                {
+                    PINE_PROFILE_ZONE("Game::frameEnd");
+                    thisType()->onFrameEnd(interpolation);
+                }
+                if(_tickLog) _tickLog->endFrame(interpolation);
                 getEngine().frameEnd();
             }
 
@@ -96,19 +120,68 @@ namespace pine
 
             Engine& getEngine() const { return *_engine; }
 
+            /// Sets the log the game's ticks are recorded to, or replayed from (see RecordGame, ReplayGame)
+            /// \param tickLog The log, or null to neither record nor replay
+            void setTickLog(TickLog* tickLog) { _tickLog = tickLog; }
+
+            /// \return The log the game's ticks are recorded to, or replayed from (may be null)
+            TickLog* getTickLog() const { return _tickLog; }
+
+            /// Records an input of the current tick, or replaces it with the recorded input whilst replaying
+            /// (the input is left as it is whilst resimulating, see isResimulating)
+            /// \param input The input, which must be trivially copyable
+            template <class TInput>
+            void logInput(TInput& input)
+            {
+                static_assert(std::is_trivially_copyable<TInput>::value, "Inputs must be trivially copyable to be logged");
+                if(_tickLog && !_isResimulating) _tickLog->input(&input, sizeof(TInput));
+            }
+
+            /// \return The load of the game's loop, see GovernedTimeStep
+            GameLoad& getLoad() { return _load; }
+            const GameLoad& getLoad() const { return _load; }
+
+            /// \return The allocator for memory that lives until the end of the frame, it is reset at the start of each frame
+            FrameAllocator& getFrameAllocator() { return _frameAllocator; }
+
+            /// \return The allocator for memory that lives until the end of the next frame,
+            ///         which must not be read by the render thread (see DoubleFrameAllocator)
+            DoubleFrameAllocator& getTwoFrameAllocator() { return _twoFrameAllocator; }
+
+            /// \return The timers of the game, which are advanced after each update
+            TimerWheel& getTimers() { return _timers; }
+
+            /// \return The queue other threads post events to the game with, this may be used from any thread
+            EventQueue& getEvents() { return _events; }
+
             int getErrorState() const { return getEngine().getErrorState(); }
             bool isRunning() const { return !getEngine().hasShutdown(); }
 
+            /// \return true whilst ticks that have already been updated are updated
+            ///         again, after the game was rolled back (see StatedGame::rollback)
+            bool isResimulating() const { return _isResimulating; }
+
+        protected:
+
+            void setResimulating(bool isResimulating) { _isResimulating = isResimulating; }
+
         private:
 
             Game* thisType() { return static_cast<Game*>(this); }
             const Game* thisType() const { return static_cast<const Game*>(this); }
 
             Engine* _engine;
+            GameLoad _load;
+            TickLog* _tickLog;
+            FrameAllocator _frameAllocator;
+            DoubleFrameAllocator _twoFrameAllocator;
+            TimerWheel _timers;
+            EventQueue _events;
+            bool _isResimulating;
         };
 
         template <class TGame>
-        struct GameWithoutEngine
+        struct GameWithoutEngine : GameType
         {
         public:
 
@@ -118,13 +191,36 @@ namespace pine
 
             GameWithoutEngine() :
                 _errorState(0),
-                _isRunning(true)
+                _isRunning(true),
+                _tickLog(nullptr),
+                _isResimulating(false)
             {
             }
 
             int getErrorState() const { return _errorState; }
             bool isRunning() const { return _isRunning; }
 
+            /// \return true whilst ticks that have already been updated are updated
+            ///         again, after the game was rolled back (see StatedGame::rollback)
+            bool isResimulating() const { return _isResimulating; }
+
+            /// \return The load of the game's loop, see GovernedTimeStep
+            GameLoad& getLoad() { return _load; }
+            const GameLoad& getLoad() const { return _load; }
+
+            /// \return The allocator for memory that lives until the end of the frame, it is reset at the start of each frame
+            FrameAllocator& getFrameAllocator() { return _frameAllocator; }
+
+            /// \return The allocator for memory that lives until the end of the next frame,
+            ///         which must not be read by the render thread (see DoubleFrameAllocator)
+            DoubleFrameAllocator& getTwoFrameAllocator() { return _twoFrameAllocator; }
+
+            /// \return The timers of the game, which are advanced after each update
+            TimerWheel& getTimers() { return _timers; }
+
+            /// \return The queue other threads post events to the game with, this may be used from any thread
+            EventQueue& getEvents() { return _events; }
+
             void quit(int errorCode)
             {
                 if(!isRunning()) return;
@@ -136,24 +232,57 @@ namespace pine
 
             void init(int argc, char* argv[])
             {
+                PINE_PROFILE_ZONE("Game::init");
                 thisType()->onInit(argc, argv);
             }
 
             void frameStart()
             { 
+                PINE_PROFILE_ZONE("Game::frameStart");
+                _frameAllocator.reset();
+                _twoFrameAllocator.swap();
                 thisType()->onFrameStart();
             }
 
             void update(Seconds deltaTime)
             {
+                PINE_PROFILE_ZONE("Game::update");
+                if(_tickLog && !_isResimulating) _tickLog->beginTick(deltaTime);
                 thisType()->onUpdate(deltaTime);
+                _timers.advance(deltaTime);
             }
 
-            void frameEnd()
+            /// Ends a frame
+            /// \param interpolation How far the game is between its previous
+            ///        and its next update, in the range [0, 1)
+            void frameEnd(Real interpolation)
             {
-                thisType()->onFrameEnd();
+                PINE_PROFILE_ZONE("Game::frameEnd");
+                thisType()->onFrameEnd(interpolation);
+                if(_tickLog) _tickLog->endFrame(interpolation);
             }
 
+            /// Sets the log the game's ticks are recorded to, or replayed from (see RecordGame, ReplayGame)
+            /// \param tickLog The log, or null to neither record nor replay
+            void setTickLog(TickLog* tickLog) { _tickLog = tickLog; }
+
+            /// \return The log the game's ticks are recorded to, or replayed from (may be null)
+            TickLog* getTickLog() const { return _tickLog; }
+
+            /// Records an input of the current tick, or replaces it with the recorded input whilst replaying
+            /// (the input is left as it is whilst resimulating, see isResimulating)
+            /// \param input The input, which must be trivially copyable
+            template <class TInput>
+            void logInput(TInput& input)
+            {
+                static_assert(std::is_trivially_copyable<TInput>::value, "Inputs must be trivially copyable to be logged");
+                if(_tickLog && !_isResimulating) _tickLog->input(&input, sizeof(TInput));
+            }
+
+        protected:
+
+            void setResimulating(bool isResimulating) { _isResimulating = isResimulating; }
+
         private:
 
             Game* thisType() { return static_cast<Game*>(this); }
@@ -161,6 +290,13 @@ namespace pine
 
             int _errorState;
             bool _isRunning;
+            GameLoad _load;
+            TickLog* _tickLog;
+            FrameAllocator _frameAllocator;
+            DoubleFrameAllocator _twoFrameAllocator;
+            TimerWheel _timers;
+            EventQueue _events;
+            bool _isResimulating;
         };
 
         template <class TGame, class TEngine>
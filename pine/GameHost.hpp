@@ -0,0 +1,539 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_GAME_HOST_HPP
+#define PINE_GAME_HOST_HPP
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <limits>
+#include <chrono>
+#include <algorithm>
+#include <type_traits>
+#include <unordered_map>
+#include <condition_variable>
+
+#include <cassert>
+
+#include <pine/Types.hpp>
+#include <pine/Game.hpp>
+#include <pine/Clock.hpp>
+#include <pine/LoopPolicy.hpp>
+#include <pine/ThreadPool.hpp>
+#include <pine/Profiler.hpp>
+
+namespace pine
+{
+    /// Identifies a game hosted by a GameHost
+    typedef std::uint64_t GameInstanceId;
+
+    /// \brief Statistics on a game hosted by a GameHost
+    struct GameInstanceStats
+    {
+        GameInstanceStats() :
+            tickCount(0),
+            frameCount(0),
+            lastFrameTime(0),
+            maxFrameTime(0),
+            totalFrameTime(0),
+            totalTickTime(0),
+            isRunning(true),
+            hasFailed(false),
+            errorState(0)
+        {
+        }
+
+        /// \return The average time it took to update the game once
+        Nanoseconds averageTickTime() const { return tickCount > 0 ? totalTickTime / static_cast<Nanoseconds>(tickCount) : 0; }
+
+        /// \return The average time it took to run one of the game's frames (its updates, and rendering)
+        Nanoseconds averageFrameTime() const { return frameCount > 0 ? totalFrameTime / static_cast<Nanoseconds>(frameCount) : 0; }
+
+        /// The amount of times the game has been updated
+        Tick tickCount;
+
+        /// The amount of frames the game has been run for
+        std::size_t frameCount;
+
+        /// The time it took to run the game's last frame
+        Nanoseconds lastFrameTime;
+
+        /// The longest time it took to run one of the game's frames
+        Nanoseconds maxFrameTime;
+
+        /// The time spent running the game
+        Nanoseconds totalFrameTime;
+
+        /// The time spent updating the game, which is part of totalFrameTime
+        Nanoseconds totalTickTime;
+
+        /// false once the game has quit (or failed)
+        bool isRunning;
+
+        /// true if the game threw an exception, and was removed
+        bool hasFailed;
+
+        /// The error code the game quit with
+        int errorState;
+    };
+
+    namespace detail
+    {
+        // a game and its engine, owned by a GameHost
+        template <class TGame, class TEngine>
+        struct HostedGame
+        {
+            HostedGame()
+            {
+                game.setEngine(engine);
+
+                // the shard's thread runs the engine's jobs, rather than threads of each instance
+                engine.setJobThreadCount(0);
+            }
+
+            ~HostedGame()
+            {
+                engine.releaseJobSystem();
+            }
+
+            TEngine engine;
+            TGame game;
+        };
+
+        template <class TGame>
+        struct HostedGame<TGame, void>
+        {
+            TGame game;
+        };
+
+        // has a hosted game's state stack load on the host's threads, and update on the shard's thread
+        template <class TGame>
+        auto share_host_threads(TGame& game, ThreadPool& loader, int) -> decltype(game.getStateStack(), void())
+        {
+            game.getStateStack().setLoader(&loader);
+            game.getStateStack().setUpdaterThreadCount(0);
+        }
+
+        // a hosted game without a state stack
+        template <class TGame>
+        void share_host_threads(TGame& game, ThreadPool& loader, long)
+        {
+        }
+    }
+
+    /// \brief Runs many games in one process
+    ///
+    /// The games (instances) are sharded across a fixed amount of threads, and the
+    /// GameStates they push asynchronously are loaded on a fixed amount of loader
+    /// threads shared by every instance; an instance creates no threads of its own
+    /// (its engine's jobs are run on its shard's thread). Each
+    /// instance has its own loop policy (and thus its own fixed time step
+    /// accumulator), and is only run once its next update is due; a shard sleeps
+    /// until the next update of any of its instances is due.
+    ///
+    /// Instances may be added and removed whilst the host is running. An instance
+    /// that quits is destroyed by its shard, but its statistics are kept until it
+    /// is removed. An instance that throws an exception is destroyed, and is marked
+    /// as failed; the other instances keep running.
+    ///
+    /// \tparam TGame The game to host
+    /// \tparam TLoopPolicy Decides how each game is updated each frame, see LoopPolicy.hpp
+    /// \author Miguel Martin
+    template <class TGame, class TLoopPolicy = FixedTimeStep<> >
+    class GameHost
+    {
+    public:
+
+        /// \param threadCount The amount of threads (shards) to run the games on
+        /// \param loaderThreadCount The amount of threads to load the games' GameStates asynchronously on
+        explicit GameHost(std::size_t threadCount = ThreadPool::defaultThreadCount(), std::size_t loaderThreadCount = 1) :
+            _loader(loaderThreadCount),
+            _shards(new Shard[threadCount]),
+            _shardCount(threadCount),
+            _nextId(1)
+        {
+            assert(threadCount > 0 && "A GameHost requires at least one thread");
+
+            for(std::size_t i = 0; i < _shardCount; ++i)
+            {
+                Shard& shard = _shards[i];
+                shard.thread = std::thread([this, &shard]() { runShard(shard); });
+            }
+        }
+
+        GameHost(const GameHost&) = delete;
+        GameHost& operator=(const GameHost&) = delete;
+
+        /// Stops every shard, quitting and destroying the instances that are still running
+        ~GameHost()
+        {
+            for(std::size_t i = 0; i < _shardCount; ++i)
+            {
+                Shard& shard = _shards[i];
+                {
+                    std::lock_guard<std::mutex> lock(shard.mutex);
+                    shard.isStopping = true;
+                }
+                shard.wake.notify_one();
+            }
+
+            for(std::size_t i = 0; i < _shardCount; ++i)
+            {
+                _shards[i].thread.join();
+            }
+        }
+
+        /// Constructs and initializes a game, and starts running it
+        /// \param argc The amount of arguments the game is initialized with
+        /// \param argv The arguments the game is initialized with
+        /// \return The id of the instance
+        GameInstanceId add(int argc = 0, char* argv[] = nullptr)
+        {
+            return add([](TGame&) {}, argc, argv);
+        }
+
+        /// Constructs and initializes a game, and starts running it
+        /// \param configure Called with the game before it is initialized, e.g. to set up a match
+        /// \param argc The amount of arguments the game is initialized with
+        /// \param argv The arguments the game is initialized with
+        /// \return The id of the instance
+        template <class F>
+        GameInstanceId add(F configure, int argc = 0, char* argv[] = nullptr)
+        {
+            std::unique_ptr<Instance> instance(new Instance);
+            detail::share_host_threads(instance->hosted.game, _loader, 0);
+            configure(instance->hosted.game);
+            instance->hosted.game.init(argc, argv);
+
+            GameInstanceId id = _nextId.fetch_add(1, std::memory_order_relaxed);
+            instance->id = id;
+
+            // the least loaded shard takes the instance
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            std::size_t shardIndex = 0;
+            for(std::size_t i = 1; i < _shardCount; ++i)
+            {
+                if(_shards[i].instanceCount < _shards[shardIndex].instanceCount)
+                {
+                    shardIndex = i;
+                }
+            }
+
+            Shard& shard = _shards[shardIndex];
+            ++shard.instanceCount;
+            {
+                std::lock_guard<std::mutex> shardLock(shard.mutex);
+                shard.admitted.push_back(std::move(instance));
+                shard.stats[id] = GameInstanceStats();
+            }
+            shard.wake.notify_one();
+
+            _shardOf[id] = shardIndex;
+            return id;
+        }
+
+        /// Removes an instance, quitting and destroying it if it is still running
+        /// \param id The id of the instance
+        void remove(GameInstanceId id)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            auto shardOf = _shardOf.find(id);
+            if(shardOf == _shardOf.end()) return;
+
+            Shard& shard = _shards[shardOf->second];
+            {
+                std::lock_guard<std::mutex> shardLock(shard.mutex);
+                shard.removed.push_back(id);
+            }
+            shard.wake.notify_one();
+
+            _shardOf.erase(shardOf);
+        }
+
+        /// Retrieves the statistics of an instance, as of its last frame
+        /// \param id The id of the instance
+        /// \param stats Set to the statistics of the instance
+        /// \return false if there is no such instance
+        bool getStats(GameInstanceId id, GameInstanceStats& stats) const
+        {
+            std::size_t shardIndex;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                auto shardOf = _shardOf.find(id);
+                if(shardOf == _shardOf.end()) return false;
+                shardIndex = shardOf->second;
+            }
+
+            Shard& shard = _shards[shardIndex];
+            std::lock_guard<std::mutex> shardLock(shard.mutex);
+
+            auto found = shard.stats.find(id);
+            if(found == shard.stats.end()) return false;
+
+            stats = found->second;
+            return true;
+        }
+
+        /// \return The amount of instances that have been added, and not removed
+        std::size_t getInstanceCount() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _shardOf.size();
+        }
+
+        /// \return The amount of threads the games are run on
+        std::size_t getShardCount() const { return _shardCount; }
+
+    private:
+
+        struct Instance
+        {
+            Instance() :
+                id(0),
+                lastTime(0),
+                dueTime(0)
+            {
+            }
+
+            GameInstanceId id;
+            detail::HostedGame<TGame, typename TGame::Engine> hosted;
+            TLoopPolicy loop;
+
+            /// The time the instance's last frame started
+            Nanoseconds lastTime;
+
+            /// The time the instance's next update is due
+            Nanoseconds dueTime;
+
+            GameInstanceStats stats;
+        };
+
+        typedef std::vector<std::unique_ptr<Instance> > InstanceArray;
+
+        struct Shard
+        {
+            Shard() :
+                instanceCount(0),
+                isStopping(false)
+            {
+            }
+
+            std::thread thread;
+
+            /// Guards everything below, except instanceCount
+            std::mutex mutex;
+            std::condition_variable wake;
+
+            /// Instances waiting to be run by the shard
+            InstanceArray admitted;
+
+            /// Instances waiting to be removed from the shard
+            std::vector<GameInstanceId> removed;
+
+            /// The statistics of the shard's instances, as of their last frame
+            std::unordered_map<GameInstanceId, GameInstanceStats> stats;
+
+            /// The amount of instances the shard runs, which the shard decrements
+            /// as soon as an instance quits or is removed
+            std::atomic<std::size_t> instanceCount;
+
+            bool isStopping;
+        };
+
+        void runShard(Shard& shard)
+        {
+            PINE_PROFILE_THREAD("GameHost shard");
+
+            InstanceArray instances;
+            InstanceArray finished;
+            SystemClock clock;
+
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            for(;;)
+            {
+                // admit and remove instances
+                for(auto& instance : shard.admitted)
+                {
+                    instance->lastTime = instance->dueTime = clock.now();
+                    instances.push_back(std::move(instance));
+                }
+                shard.admitted.clear();
+
+                for(GameInstanceId id : shard.removed)
+                {
+                    auto removed = std::find_if(instances.begin(), instances.end(), [&](const std::unique_ptr<Instance>& i) { return i->id == id; });
+                    if(removed != instances.end())
+                    {
+                        (*removed)->hosted.game.quit(0);
+                        instances.erase(removed);
+                        --shard.instanceCount;
+                    }
+                    shard.stats.erase(id);
+                }
+                shard.removed.clear();
+
+                if(shard.isStopping) break;
+
+                lock.unlock();
+
+                Nanoseconds nextDueTime = runDueInstances(instances, finished, clock);
+
+                lock.lock();
+
+                // publish the statistics
+                for(auto& instance : instances)
+                {
+                    auto stats = shard.stats.find(instance->id);
+                    if(stats != shard.stats.end()) stats->second = instance->stats;
+                }
+                for(auto& instance : finished)
+                {
+                    auto stats = shard.stats.find(instance->id);
+                    if(stats != shard.stats.end()) stats->second = instance->stats;
+                }
+                shard.instanceCount -= finished.size();
+                finished.clear();
+
+                // sleep until an update is due, or an instance is added or removed
+                auto hasWork = [&shard]() { return shard.isStopping || !shard.admitted.empty() || !shard.removed.empty(); };
+                if(nextDueTime == std::numeric_limits<Nanoseconds>::max())
+                {
+                    shard.wake.wait(lock, hasWork);
+                }
+                else
+                {
+                    Nanoseconds sleepTime = nextDueTime - clock.now();
+                    if(sleepTime > 0)
+                    {
+                        shard.wake.wait_for(lock, std::chrono::nanoseconds(sleepTime), hasWork);
+                    }
+                }
+            }
+
+            for(auto& instance : instances)
+            {
+                instance->hosted.game.quit(0);
+            }
+            instances.clear();
+        }
+
+        /// Runs a frame of each instance whose next update is due
+        /// \param instances The instances of a shard
+        /// \param finished Receives the instances that have quit
+        /// \return The time the next update of any instance is due
+        Nanoseconds runDueInstances(InstanceArray& instances, InstanceArray& finished, SystemClock& clock)
+        {
+            PINE_PROFILE_ZONE("GameHost::runDueInstances");
+
+            Nanoseconds nextDueTime = std::numeric_limits<Nanoseconds>::max();
+
+            for(auto& instance : instances)
+            {
+                Nanoseconds startTime = clock.now();
+                if(instance->dueTime <= startTime && instance->hosted.game.isRunning())
+                {
+                    runFrame(*instance, startTime, clock);
+                    instance->stats.lastFrameTime = clock.now() - startTime;
+                    instance->stats.maxFrameTime = std::max(instance->stats.maxFrameTime, instance->stats.lastFrameTime);
+                    instance->stats.totalFrameTime += instance->stats.lastFrameTime;
+                }
+
+                if(instance->hosted.game.isRunning() && !instance->stats.hasFailed)
+                {
+                    nextDueTime = std::min(nextDueTime, instance->dueTime);
+                }
+                else
+                {
+                    instance->stats.isRunning = false;
+                    if(!instance->stats.hasFailed)
+                    {
+                        instance->stats.errorState = instance->hosted.game.getErrorState();
+                    }
+                }
+            }
+
+            for(auto& instance : instances)
+            {
+                if(!instance->stats.isRunning)
+                {
+                    finished.push_back(std::move(instance));
+                }
+            }
+            instances.erase(std::remove(instances.begin(), instances.end(), nullptr), instances.end());
+
+            return nextDueTime;
+        }
+
+        void runFrame(Instance& instance, Nanoseconds startTime, SystemClock& clock)
+        {
+            TGame& game = instance.hosted.game;
+
+            Nanoseconds frameTime = startTime - instance.lastTime;
+            instance.lastTime = startTime;
+
+            try
+            {
+                game.frameStart();
+
+                Nanoseconds tickStartTime = clock.now();
+                Real interpolation = instance.loop.advance(game, frameTime);
+                instance.stats.totalTickTime += clock.now() - tickStartTime;
+
+                game.frameEnd(interpolation);
+            }
+            catch(...)
+            {
+                instance.stats.hasFailed = true;
+            }
+
+            instance.dueTime = startTime + instance.loop.timeUntilNextTick();
+            instance.stats.tickCount = instance.loop.getTickCount();
+            ++instance.stats.frameCount;
+        }
+
+        /// The threads the instances' GameStates are loaded on, shared by every instance
+        ThreadPool _loader;
+
+        std::unique_ptr<Shard[]> _shards;
+        std::size_t _shardCount;
+
+        std::atomic<GameInstanceId> _nextId;
+
+        /// The shard each instance was added to
+        std::unordered_map<GameInstanceId, std::size_t> _shardOf;
+        mutable std::mutex _mutex;
+    };
+}
+
+#endif // PINE_GAME_HOST_HPP
@@ -0,0 +1,206 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_GAME_LOAD_HPP
+#define PINE_GAME_LOAD_HPP
+
+#include <vector>
+#include <algorithm>
+
+#include <pine/Types.hpp>
+
+namespace pine
+{
+    /// \brief How a frame of the game loop coped with the time that had passed
+    struct FrameLoad
+    {
+        FrameLoad() :
+            dueSteps(0),
+            substeps(0),
+            droppedSteps(0),
+            mergedSteps(0),
+            backlog(0),
+            isOverloaded(false)
+        {
+        }
+
+        /// The amount of fixed steps that were due in the frame
+        Tick dueSteps;
+
+        /// The amount of times the game was updated in the frame
+        unsigned substeps;
+
+        /// The amount of steps that were skipped, their time is lost
+        Tick droppedSteps;
+
+        /// The amount of steps that were merged into larger updates
+        Tick mergedSteps;
+
+        /// The simulated time the game is behind by, once the frame has been updated
+        Nanoseconds backlog;
+
+        /// true if more steps were due than could be run
+        bool isOverloaded;
+    };
+
+    /// \brief Statistics on the load of the game loop
+    struct LoadStats
+    {
+        LoadStats() :
+            frameCount(0),
+            overloadedFrameCount(0),
+            substepCount(0),
+            droppedStepCount(0),
+            mergedStepCount(0),
+            maxBacklog(0)
+        {
+        }
+
+        std::size_t frameCount;
+        std::size_t overloadedFrameCount;
+        Tick substepCount;
+        Tick droppedStepCount;
+        Tick mergedStepCount;
+        Nanoseconds maxBacklog;
+    };
+
+    class GameLoad;
+
+    /// \brief Listens to the load of the game loop
+    /// \author Miguel Martin
+    class LoadListener
+    {
+        friend GameLoad;
+
+    public:
+
+        virtual ~LoadListener() {}
+
+    private:
+
+        virtual void onFrameOverloaded(GameLoad& sender, const FrameLoad& frame) {}
+        virtual void onUnderLoadChanged(GameLoad& sender, bool isUnderLoad) {}
+    };
+
+    /// \brief Tracks the load of a game's loop
+    ///
+    /// Loop policies that govern their substeps (see GovernedTimeStep) report
+    /// each frame to the game's load. The game is under load from the first
+    /// overloaded frame, until a number of frames in a row have not been
+    /// overloaded; whilst it is under load, states may shed optional work.
+    ///
+    /// \author Miguel Martin
+    class GameLoad
+    {
+    public:
+
+        /// The default amount of frames in a row that must not be overloaded to no longer be under load
+        static constexpr unsigned defaultRecoveryFrameCount() { return 30; }
+
+        GameLoad() :
+            _recoveryFrameCount(defaultRecoveryFrameCount()),
+            _framesSinceOverload(0),
+            _isUnderLoad(false)
+        {
+        }
+
+        /// \return true if the game is under load, and should shed optional work
+        bool isUnderLoad() const { return _isUnderLoad; }
+
+        /// \return How the last frame coped with the time that had passed
+        const FrameLoad& getLastFrame() const { return _lastFrame; }
+
+        const LoadStats& getStats() const { return _stats; }
+        void resetStats() { _stats = LoadStats(); }
+
+        /// \param frameCount The amount of frames in a row that must not be overloaded to no longer be under load
+        void setRecoveryFrameCount(unsigned frameCount) { _recoveryFrameCount = frameCount; }
+        unsigned getRecoveryFrameCount() const { return _recoveryFrameCount; }
+
+        /// Reports a frame, this is called by the loop policy
+        /// \param frame How the frame coped with the time that had passed
+        void reportFrame(const FrameLoad& frame)
+        {
+            _lastFrame = frame;
+
+            ++_stats.frameCount;
+            _stats.substepCount += frame.substeps;
+            _stats.droppedStepCount += frame.droppedSteps;
+            _stats.mergedStepCount += frame.mergedSteps;
+            _stats.maxBacklog = std::max(_stats.maxBacklog, frame.backlog);
+
+            bool wasUnderLoad = _isUnderLoad;
+            if(frame.isOverloaded)
+            {
+                ++_stats.overloadedFrameCount;
+                _framesSinceOverload = 0;
+                _isUnderLoad = true;
+
+                for(auto& listener : _listeners)
+                {
+                    listener->onFrameOverloaded(*this, frame);
+                }
+            }
+            else if(_isUnderLoad && ++_framesSinceOverload >= _recoveryFrameCount)
+            {
+                _isUnderLoad = false;
+            }
+
+            if(_isUnderLoad != wasUnderLoad)
+            {
+                for(auto& listener : _listeners)
+                {
+                    listener->onUnderLoadChanged(*this, _isUnderLoad);
+                }
+            }
+        }
+
+        void addListener(LoadListener* listener)
+        {
+            _listeners.push_back(listener);
+        }
+
+        void removeListener(LoadListener* listener)
+        {
+            _listeners.erase(std::remove(_listeners.begin(), _listeners.end(), listener), _listeners.end());
+        }
+
+    private:
+
+        std::vector<LoadListener*> _listeners;
+
+        FrameLoad _lastFrame;
+        LoadStats _stats;
+
+        unsigned _recoveryFrameCount;
+        unsigned _framesSinceOverload;
+        bool _isUnderLoad;
+    };
+}
+
+#endif // PINE_GAME_LOAD_HPP
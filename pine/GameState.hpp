@@ -29,13 +29,55 @@
 #ifndef PINE_GAME_SATE_HPP
 #define PINE_GAME_SATE_HPP
 
-#include <pine/types.hpp>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#include <pine/Types.hpp>
+#include <pine/EventQueue.hpp>
 
 namespace pine
 {
     template <class TGame>
     class GameStateStack;
 
+    /// \brief How often a GameState is updated, relative to the ticks of its GameStateStack
+    ///
+    /// A GameState is updated `updatesPerTick` times once every `ticksPerUpdate`
+    /// ticks, and each of these updates is given an equal share of the time
+    /// that has passed since the GameState was last updated.
+    struct UpdateRate
+    {
+        UpdateRate() :
+            ticksPerUpdate(1),
+            updatesPerTick(1)
+        {
+        }
+
+        UpdateRate(unsigned ticksPerUpdate, unsigned updatesPerTick) :
+            ticksPerUpdate(ticksPerUpdate),
+            updatesPerTick(updatesPerTick)
+        {
+            assert(ticksPerUpdate > 0 && updatesPerTick > 0 && "An UpdateRate must update at least once");
+        }
+
+        /// \return The rate of a GameState that is updated once each tick
+        static UpdateRate everyTick() { return UpdateRate(); }
+
+        /// \return The rate of a GameState that is updated once every few ticks,
+        ///         e.g. every(12) updates at 5Hz when the game ticks at 60Hz
+        static UpdateRate every(unsigned ticks) { return UpdateRate(ticks, 1); }
+
+        /// \return The rate of a GameState that is updated several times each tick,
+        ///         e.g. timesPerTick(2) updates at 120Hz when the game ticks at 60Hz
+        static UpdateRate timesPerTick(unsigned updates) { return UpdateRate(1, updates); }
+
+        unsigned ticksPerUpdate;
+        unsigned updatesPerTick;
+    };
+
     /// \brief Describes a state in your game
     /// \tparam TGameConcept A game concept
     /// \tparam TEngineConcept An engine concept, which derives from GameEngine
@@ -58,7 +100,9 @@ namespace pine
 
         /// Default constructor
         GameState() : 
-            _game(nullptr)
+            _game(nullptr),
+            _loadingProgress(0),
+            _sleepTime(0)
         {
         }
 
@@ -74,22 +118,96 @@ namespace pine
         const Game& getGame() const
         { return *_game; }
 
+        /// \return How far the state is through loading its resources, in the range [0, 1]
+        Real getLoadingProgress() const
+        { return _loadingProgress.load(std::memory_order_relaxed); }
+
+    protected:
+
+        /// Reports how far the state is through loading its resources.
+        /// This may be called from loadResources(), which is run on a
+        /// background thread if the state was pushed asynchronously.
+        /// \param progress The progress, in the range [0, 1]
+        void setLoadingProgress(Real progress)
+        { _loadingProgress.store(progress, std::memory_order_relaxed); }
+
+        /// Has the stack skip the state's updates until it has been updated for an
+        /// amount of time, without calling update() in between; the time of the
+        /// skipped updates is handed to the update the state wakes in.
+        /// This may only be called from update().
+        /// \param duration The time to sleep for
+        void sleepFor(Seconds duration)
+        { _sleepTime = duration; }
+
     private:
 
         virtual void init() {}
         virtual void loadResources() {}
         virtual void unloadResources() {}
         virtual void update(pine::Seconds deltaTime) {}
-        virtual void render() {}
+        virtual void render(Real interpolation) {}
 
         // Events
         virtual void onPause() { }
         virtual void onResume() { }
 
+        /// Handles an event posted to the game (see GameStateStack::dispatch)
+        /// \return true if the event was consumed, false to pass it on to the state below
+        virtual bool onEvent(const GameEvent& event) { return false; }
+
+        // Caching (see GameStateStack::pushCached)
+        virtual void onSuspend() { }
+        virtual void onRevive() { }
+
+        /// \return The approximate amount of memory the state's resources use, in bytes,
+        ///         this is used to keep the GameStateStack's cache within its budget
+        virtual std::size_t getResourceSize() const { return 0; }
+
+        /// \return true if update() neither reads nor changes anything another GameState
+        ///         updates, so that it may be called on a worker thread whilst the
+        ///         other GameStates are updated (see GameStateStack::update)
+        virtual bool hasIndependentUpdate() const { return false; }
+
+        /// \return How often the state is updated (see GameStateStack::update), this is
+        ///         asked for once each time the state is pushed on the stack
+        virtual UpdateRate getUpdateRate() const { return UpdateRate(); }
+
+        // Pipelined rendering (see RunPipelinedGame)
+
+        /// Copies what the state needs to render the frame it has just updated into a snapshot,
+        /// this is called on the simulation thread (see SnapshotBuffer)
+        /// \param slot The slot of the snapshot
+        virtual void produceSnapshot(std::size_t slot) {}
+
+        /// Renders a snapshot, this is called on the render thread whilst the state may be updated
+        /// on the simulation thread, so only the snapshot may be read
+        /// \param slot The slot of the snapshot
+        /// \param interpolation How far the frame is between its previous and its next update
+        virtual void consumeSnapshot(std::size_t slot, Real interpolation) {}
+
+        // Rollback (see GameStateStack::setRollbackWindow)
+
+        /// \return The amount of bytes saveState() writes, or 0 if the state is not rolled back
+        virtual std::size_t getSavedStateSize() const { return 0; }
+
+        /// Copies everything update() changes into a buffer of getSavedStateSize() bytes
+        /// \param buffer The buffer to write to
+        virtual void saveState(void* buffer) const {}
+
+        /// Restores what saveState() wrote
+        /// \param buffer The buffer to read from
+        virtual void restoreState(const void* buffer) {}
+
     private:
 
         /// The game attached to the state
         Game* _game; // guaranteed to not be null
+
+        /// How far the state is through loading its resources
+        std::atomic<Real> _loadingProgress;
+
+        /// The time the state asked to sleep for in its last update, taken by the stack
+        Seconds _sleepTime;
     };
 
     template <class TGame>
@@ -97,6 +215,45 @@ namespace pine
     {
         /* do nothing */
     }
+
+    /// \brief A GameState that keeps what it simulates in a trivially copyable block,
+    ///        which is saved and restored with a single memcpy when the stack is rolled back
+    /// \tparam TGame A game concept
+    /// \tparam TData The simulated data, which must be trivially copyable
+    ///
+    /// Anything the state changes in update() should live in the data, anything
+    /// else (e.g. the state's resources) is left as it is when the stack is rolled back.
+    template <class TGame, class TData>
+    class RollbackGameState : public GameState<TGame>
+    {
+        static_assert(std::is_trivially_copyable<TData>::value, "The data of a RollbackGameState must be trivially copyable");
+
+    public:
+
+        using Data = TData;
+
+        RollbackGameState() :
+            _data()
+        {
+        }
+
+        /// \return The simulated data
+        Data& getData()
+        { return _data; }
+
+        /// \return The simulated data
+        const Data& getData() const
+        { return _data; }
+
+    private:
+
+        virtual std::size_t getSavedStateSize() const override { return sizeof(Data); }
+        virtual void saveState(void* buffer) const override { std::memcpy(buffer, &_data, sizeof(Data)); }
+        virtual void restoreState(const void* buffer) override { std::memcpy(&_data, buffer, sizeof(Data)); }
+
+        /// The simulated data
+        Data _data;
+    };
 }
 
 #endif // PINE_GAME_STATE_HPP
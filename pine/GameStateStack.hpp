@@ -29,14 +29,30 @@
 #ifndef PINE_GAMESTATESTACK_HPP
 #define PINE_GAMESTATESTACK_HPP
 
+#include <list>
+#include <deque>
+#include <limits>
+#include <string>
 #include <vector>
+#include <typeinfo>
 #include <memory>
+#include <chrono>
+#include <future>
 #include <utility>
+#include <exception>
 #include <algorithm>
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 
 #include <pine/GameState.hpp>
+#include <pine/ThreadPool.hpp>
+#include <pine/JobSystem.hpp>
+#include <pine/StateAllocator.hpp>
+#include <pine/Profiler.hpp>
+#include <pine/RenderPipeline.hpp>
+#include <pine/TimerWheel.hpp>
 
 namespace pine
 {
@@ -84,9 +100,56 @@ namespace pine
 
         virtual void onGameStateWillBePushed(TGameStateStack& sender, typename TGameStateStack::State& gameState) {}
         virtual void onGameStateWasPushed(TGameStateStack& sender, typename TGameStateStack::State& gameState) {}
+        virtual void onGameStateLoadingProgress(TGameStateStack& sender, typename TGameStateStack::State& gameState, Real progress) {}
+        virtual void onGameStateFinishedLoading(TGameStateStack& sender, typename TGameStateStack::State& gameState) {}
         virtual void onGameStateWillBeRemoved(TGameStateStack& sender, typename TGameStateStack::State& gameState) {}
         virtual void onStackWillBePopped(TGameStateStack& sender) {}
         virtual void onStackWillBeCleared(TGameStateStack& sender) {}
+        virtual void onStackChanged(TGameStateStack& sender) {}
+    };
+
+    /// \brief Refers to a GameState pushed on a GameStateStack
+    ///
+    /// A handle stays safe to use once its GameState has left the stack,
+    /// it simply no longer refers to a GameState (see GameStateStack::isAlive).
+    struct GameStateHandle
+    {
+        GameStateHandle() :
+            index(0),
+            generation(0)
+        {
+        }
+
+        GameStateHandle(std::uint32_t index, std::uint32_t generation) :
+            index(index),
+            generation(generation)
+        {
+        }
+
+        std::uint32_t index;
+
+        /// 0 for a handle that refers to no GameState
+        std::uint32_t generation;
+    };
+
+    /// \brief Statistics on a GameStateStack's cache
+    struct StateCacheStats
+    {
+        StateCacheStats() :
+            hitCount(0),
+            missCount(0),
+            evictionCount(0)
+        {
+        }
+
+        /// The amount of pushes that revived a cached GameState
+        std::size_t hitCount;
+
+        /// The amount of pushes that had to construct a new GameState
+        std::size_t missCount;
+
+        /// The amount of GameStates destroyed to keep the cache within its budget
+        std::size_t evictionCount;
     };
 
     /// \brief Resembles a stack of game states
@@ -103,6 +166,19 @@ namespace pine
         using Listener = GameStateStackListener<ThisType>;
 
         explicit GameStateStack(Game& game, State* gameState = nullptr) :
+            _iterationDepth(0),
+            _cacheSize(0),
+            _cacheMaxCount(0),
+            _cacheMaxSize(std::numeric_limits<std::size_t>::max()),
+            _sharedLoader(nullptr),
+            _loaderThreadCount(ThreadPool::defaultThreadCount()),
+            _sharedUpdater(nullptr),
+            _updaterThreadCount(ThreadPool::defaultThreadCount()),
+            _pipeline(nullptr),
+            _tick(0),
+            _timers(nullptr),
+            _freeSlot(NONE),
+            _allocator(nullptr),
             _game(&game)
         {
             if(gameState) push(gameState);
@@ -113,67 +189,273 @@ namespace pine
         GameStateStack& operator=(const ThisType&) = default;
         GameStateStack& operator=(ThisType&&) = default;
 
-        ~GameStateStack() { clear(); }
+        ~GameStateStack()
+        {
+            // states that are still loading must finish before they can be unloaded
+            for(auto& loadingState : _loading)
+            {
+                loadingState.loaded.wait();
+            }
+            _loading.clear();
+
+            while(!_pendingChanges.empty())
+            {
+                discard(_pendingChanges.front());
+                _pendingChanges.pop_front();
+            }
+
+            setRollbackWindow(0);
+            setRenderPipeline(nullptr);
+
+            setCacheBudget(0);
+            clear();
+        }
 
         template <class TGameState, class... Args>
-        void push(Args&&... args)
+        GameStateHandle push(Args&&... args)
         {
-            push<TGameState, PushType::Default>(std::forward<Args>(args)...);
+            return push<TGameState, PushType::Default>(std::forward<Args>(args)...);
         }
 
+        /// Constructs a GameState with the stack's allocator, and pushes it on the stack
+        /// \tparam Push The PushType that you wish to push the GameState with
+        /// \param args The arguments to construct the GameState with
+        /// \return A handle to the GameState
         template <class TGameState, PushType Push, class... Args>
-        void push(Args&&... args)
+        GameStateHandle push(Args&&... args)
         {
-            push(new TGameState{std::forward<Args>(args)...}, Push);
+            return pushState(StackEntry{makeState<TGameState>(std::forward<Args>(args)...), Push}, Activation::Load);
         }
 
         /// Pushes a GameState on the stack
         /// \param gameState The GameState you wish to add on the stack (should be allocated on the free-store [heap])
         /// \param pushType The PushType that you wish to push the GameState with
+        /// \return A handle to the GameState
         /// \see PushType for details
-        void push(State* gameState, PushType pushType = PushType::Default)
+        GameStateHandle push(State* gameState, PushType pushType = PushType::Default)
         {
             assert(gameState && "GameState is null, please offer a non-null GameState");
+            return pushState(StackEntry{GameStatePtrImpl{gameState}, pushType}, Activation::Load);
+        }
 
-            for(auto& listener : _listeners)
+        template <class TGameState, class... Args>
+        GameStateHandle pushCached(Args&&... args)
+        {
+            return pushCached<TGameState, PushType::Default>(std::forward<Args>(args)...);
+        }
+
+        /// Pushes a GameState on the stack, reviving a cached GameState of the same type if there is one
+        /// \tparam Push The PushType that you wish to push the GameState with
+        /// \param args The arguments to construct the GameState with, if it is not cached
+        /// \see pushCachedWithKey
+        template <class TGameState, PushType Push, class... Args>
+        GameStateHandle pushCached(Args&&... args)
+        {
+            return pushCachedWithKey<TGameState, Push>(std::string(), std::forward<Args>(args)...);
+        }
+
+        template <class TGameState, class... Args>
+        GameStateHandle pushCachedWithKey(const std::string& key, Args&&... args)
+        {
+            return pushCachedWithKey<TGameState, PushType::Default>(key, std::forward<Args>(args)...);
+        }
+
+        /// Pushes a GameState on the stack, reviving a cached GameState of the same type and key if there is one
+        ///
+        /// When a GameState pushed with this method leaves the stack, it is
+        /// suspended (onSuspend()) and kept in the stack's cache, rather than
+        /// being destroyed; its resources stay loaded. If it is pushed again
+        /// whilst it is cached, it is revived (onRevive()) instead of having its
+        /// resources loaded and being initialized. GameStates are evicted from the
+        /// cache, least recently used first, to keep it within its budget.
+        ///
+        /// \tparam Push The PushType that you wish to push the GameState with
+        /// \param key Distinguishes GameStates of the same type, e.g. the name of a level
+        /// \param args The arguments to construct the GameState with, if it is not cached
+        /// \return A handle to the GameState, a revived GameState is given a new handle
+        /// \see setCacheBudget
+        template <class TGameState, PushType Push, class... Args>
+        GameStateHandle pushCachedWithKey(const std::string& key, Args&&... args)
+        {
+            auto cached = std::find_if(_cache.begin(), _cache.end(), [&](const CachedState& c)
             {
-                listener->onGameStateWillBePushed(*this, *gameState);
+                return *c.entry.cacheType == typeid(TGameState) && c.entry.cacheKey == key;
+            });
+
+            if(cached != _cache.end())
+            {
+                ++_cacheStats.hitCount;
+
+                StackEntry entry = std::move(cached->entry);
+                entry.pushType = Push;
+                _cacheSize -= cached->size;
+                _cache.erase(cached);
+
+                return pushState(std::move(entry), Activation::Revive);
+            }
+            else
+            {
+                ++_cacheStats.missCount;
+                return pushState(StackEntry{makeState<TGameState>(std::forward<Args>(args)...), Push, &typeid(TGameState), key}, Activation::Load);
             }
+        }
 
-            switch(pushType)
+        template <class TGameState, class... Args>
+        GameStateHandle pushAsync(Args&&... args)
+        {
+            return pushAsync<TGameState, PushType::Default>(std::forward<Args>(args)...);
+        }
+
+        template <class TGameState, PushType Push, class... Args>
+        GameStateHandle pushAsync(Args&&... args)
+        {
+            return pushStateAsync(makeState<TGameState>(std::forward<Args>(args)...), Push);
+        }
+
+        /// Pushes a GameState on the stack, loading its resources in the background
+        ///
+        /// The GameState's resources are loaded on the loader's worker threads,
+        /// whilst the game keeps running. Once loading has completed, the GameState
+        /// is pushed on the stack at the start of the next frame (see activateLoadedStates()).
+        /// GameStates pushed asynchronously are activated in the order they were pushed.
+        ///
+        /// \param gameState The GameState you wish to add on the stack (should be allocated on the free-store [heap])
+        /// \param pushType The PushType that you wish to push the GameState with
+        /// \return A handle to the GameState, which is alive whilst it is loading
+        /// \note loadResources() is called on a different thread, it must not touch
+        ///       anything that the game loop uses without synchronisation
+        GameStateHandle pushAsync(State* gameState, PushType pushType = PushType::Default)
+        {
+            assert(gameState && "GameState is null, please offer a non-null GameState");
+            return pushStateAsync(GameStatePtrImpl{gameState}, pushType);
+        }
+
+        /// Pushes GameStates that have finished loading asynchronously on to the stack,
+        /// and notifies listeners of the loading progress of the remaining GameStates.
+        /// This is called at the start of each frame by StatedGame.
+        void activateLoadedStates()
+        {
+            PINE_PROFILE_ZONE("GameStateStack::activateLoadedStates");
+
+            applyPendingChanges();
+
+            for(auto& loadingState : _loading)
             {
-                case PushType::PushAndPop:
-                    pop();
-                    break;
-                case PushType::PushAndPopAllPreviousStates:
-                    clear();
-                    break;
-                default:
-                    break;
+                Real progress = loadingState.state->getLoadingProgress();
+                if(progress == loadingState.notifiedProgress) continue;
+
+                loadingState.notifiedProgress = progress;
+                for(auto& listener : _listeners)
+                {
+                    listener->onGameStateLoadingProgress(*this, *loadingState.state, progress);
+                }
             }
 
-            // if the stack isn't empty and we're not silently pushing
-            // then tell the stack we're gonna pause everyone
-            if(!_stack.empty() && pushType != PushType::PushWithoutPoppingSilenty)
+            while(!_loading.empty() && _loading.front().loaded.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
             {
-                perform_f_on_stack([](State* state) { state->onPause(); });
+                LoadingGameState loadingState = std::move(_loading.front());
+                _loading.pop_front();
+
+                // re-throws any exception that occurred whilst loading,
+                // the GameState is destroyed so its handle must no longer be alive
+                try
+                {
+                    loadingState.loaded.get();
+                }
+                catch(...)
+                {
+                    if(_timers) _timers->cancelAll(loadingState.state.get());
+                    releaseSlot(loadingState.slot);
+                    throw;
+                }
+
+                for(auto& listener : _listeners)
+                {
+                    listener->onGameStateFinishedLoading(*this, *loadingState.state);
+                }
+
+                StackEntry entry{std::move(loadingState.state), loadingState.pushType};
+                entry.slot = loadingState.slot;
+                activate(std::move(entry), Activation::Init);
             }
+        }
 
-            _stack.emplace_back(GameStatePtrImpl{gameState}, pushType);
-            gameState->_game = _game;
+        /// \return true if there are GameStates being loaded asynchronously
+        bool isLoading() const { return !_loading.empty(); }
 
-            // load resources
-            gameState->loadResources();
+        /// \return The amount of GameStates being loaded asynchronously
+        std::size_t getLoadingCount() const { return _loading.size(); }
 
-            // initialize the state
-            gameState->init();
+        /// \return true if a GameState is being loaded asynchronously (i.e. it is not on the stack yet)
+        bool isLoading(const State& gameState) const
+        {
+            return std::find_if(_loading.begin(), _loading.end(), [&](const LoadingGameState& l) { return l.state.get() == &gameState; }) != _loading.end();
+        }
 
-            gameState->onResume();
+        /// Sets the allocator used to allocate the GameStates constructed by the stack
+        /// \param allocator The allocator, or null to allocate GameStates with new
+        /// \note The allocator must outlive every GameState it allocates
+        void setAllocator(StateAllocator* allocator) { _allocator = allocator; }
+
+        /// \return The allocator used to allocate the GameStates constructed by the stack (may be null)
+        StateAllocator* getAllocator() const { return _allocator; }
+
+        /// Sets the timers that GameStates bind their timers to, the timers bound to
+        /// a GameState are cancelled when it leaves the stack, and the timers are saved with each
+        /// tick that is kept to roll back to (StatedGame sets the game's timers)
+        /// \param timers The timers, or null
+        void setTimerWheel(TimerWheel* timers) { _timers = timers; }
+
+        /// \return The timers that GameStates bind their timers to (may be null)
+        TimerWheel* getTimerWheel() const { return _timers; }
+
+        /// Sets the amount of threads used to load GameStates asynchronously
+        /// \param threadCount The amount of threads
+        /// \note This must be called before the first asynchronous push
+        void setLoaderThreadCount(std::size_t threadCount)
+        {
+            assert(!_loader && "The loader has already been created");
+            _loaderThreadCount = threadCount;
         }
 
+        /// Sets the threads used to load GameStates asynchronously, rather than the
+        /// stack creating threads of its own (e.g. to share them between many stacks)
+        /// \param loader The threads, or null to have the stack create its own
+        /// \note This must be called before the first asynchronous push,
+        ///       and the threads must outlive the stack
+        void setLoader(ThreadPool* loader)
+        {
+            assert(!_loader && _loading.empty() && "The loader is already in use");
+            _sharedLoader = loader;
+        }
+
+        /// Sets the amount of threads used to update GameStates with an independent update,
+        /// if the stack creates a JobSystem of its own (see setUpdater)
+        /// \param threadCount The amount of threads, or 0 to update every GameState on the calling thread
+        /// \note This must be called before the first update that uses the threads
+        void setUpdaterThreadCount(std::size_t threadCount)
+        {
+            assert(!_updater && "The updater has already been created");
+            _updaterThreadCount = threadCount;
+        }
+
+        /// Sets the jobs used to update GameStates with an independent update, rather than
+        /// the stack creating a JobSystem of its own (StatedGame sets the engine's job system)
+        /// \param updater The job system, or null to have the stack create its own
+        /// \note The job system must outlive every update that uses it
+        void setUpdater(JobSystem* updater) { _sharedUpdater = updater; }
+
         /// Pops the GameState stack
         void pop()
         {
+            assertNotUpdatingIndependently();
+
+            if(isDeferringChanges())
+            {
+                _pendingChanges.push_back(StackChange{StackChange::Type::Pop});
+                return;
+            }
+
             if(_stack.empty()) return; 
 
             for(auto& listener : _listeners)
@@ -182,9 +464,11 @@ namespace pine
             }
 
             // if the last state was silent
-            bool wasSilent = _stack.back().second == PushType::PushWithoutPoppingSilenty;
+            bool wasSilent = _stack.back().pushType == PushType::PushWithoutPoppingSilenty;
 
+            StackEntry entry = std::move(_stack.back());
             _stack.pop_back();
+            retire(entry);
 
             // call onResume on every other state in the stack that was on previous top
             if(!wasSilent)
@@ -193,110 +477,1639 @@ namespace pine
             }
         }
 
+        /// Updates the necessary GameStates in the stack
+        ///
+        /// If more than one GameState is updated (i.e. GameStates were pushed silently),
+        /// the GameStates with an independent update (see GameState::hasIndependentUpdate)
+        /// are updated as jobs on the updater (see setUpdater), whilst the other GameStates are
+        /// updated on this thread, in order, from the top of the stack down. The independent
+        /// GameStates are split into a job per thread, rather than a job each. Every update
+        /// has finished by the time this returns.
+        ///
+        /// Each GameState is updated at its own rate (see GameState::getUpdateRate). A GameState
+        /// that is updated once every few ticks accumulates the time of the ticks it skips, and
+        /// is given it all on the tick it is updated. When such a GameState is pushed, it is
+        /// first updated on the tick (within its period) that the fewest other GameStates are
+        /// updated on, so that GameStates with the same rate are spread across the ticks.
+        /// Ticks only count towards a GameState's rate whilst it is updated, i.e. not whilst it is paused.
+        /// A GameState that sleeps (see GameState::sleepFor) is not updated at all until it wakes.
+        ///
+        /// \note A GameState with an independent update must not change the stack
+        ///       (this is asserted), as it may be updated on another thread
         void update(Seconds deltaTime)
         {
-            perform_f_on_stack([&](State* state) { state->update(deltaTime); });
+            PINE_PROFILE_ZONE("GameStateStack::update");
+
+            bool isParallel = _stack.size() > 1 && _stack.back().pushType == PushType::PushWithoutPoppingSilenty &&
+                              (_sharedUpdater ? _sharedUpdater->getThreadCount() : _updaterThreadCount) > 0;
+
+            ++_iterationDepth;
+            try
+            {
+                // the GameStates due this tick are gathered first, so that the independent
+                // GameStates are updated by the updater's threads whilst the others are updated here
+                _updates.clear();
+                _independentUpdates.clear();
+                perform_f_on_entries([&](StackEntry& entry)
+                {
+                    // the stack's entries are not moved whilst it is iterated
+                    ScheduledUpdate update{&entry, 0, 0, nullptr};
+                    update.count = advanceSchedule(entry, deltaTime, update.time);
+                    if(update.count == 0) return;
+
+                    if(isParallel && entry.state->hasIndependentUpdate())
+                    {
+                        _independentUpdates.push_back(update);
+                    }
+                    else
+                    {
+                        _updates.push_back(update);
+                    }
+                });
+
+                if(!_independentUpdates.empty())
+                {
+                    JobSystem& updater = getUpdater();
+                    std::size_t jobCount = updater.getThreadCount() + 1;
+                    std::size_t grainSize = (_independentUpdates.size() + jobCount - 1) / jobCount;
+                    _updating = updater.parallelFor(0, _independentUpdates.size(), grainSize, [this](std::size_t i)
+                    {
+                        updateIndependently(_independentUpdates[i]);
+                    });
+                }
+
+                for(auto& update : _updates)
+                {
+                    updateState(*update.entry, update.count, update.time);
+                }
+            }
+            catch(...)
+            {
+                joinUpdates();
+                --_iterationDepth;
+                throw;
+            }
+
+            std::exception_ptr error = joinUpdates();
+            --_iterationDepth;
+
+            // re-throws any exception that occurred whilst updating
+            if(error) std::rethrow_exception(error);
+
+            applyPendingChanges();
+            ++_tick;
+        }
+
+        /// Routes an event to the GameStates that are updated, from the top of the stack
+        /// down, until one of them consumes it (see GameState::onEvent)
+        /// \param event The event
+        /// \return true if the event was consumed
+        bool dispatch(const GameEvent& event)
+        {
+            bool isConsumed = false;
+            perform_f_on_stack([&](State* state)
+            {
+                if(!isConsumed) isConsumed = state->onEvent(event);
+            });
+
+            applyPendingChanges();
+            return isConsumed;
         }
 
-        void render()
+        /// Renders the necessary GameStates in the stack
+        /// \param interpolation How far the game is between its previous
+        ///        and its next update, in the range [0, 1)
+        void render(Real interpolation)
         {
-            perform_f_on_stack([](State* state) { state->render(); });
+            PINE_PROFILE_ZONE("GameStateStack::render");
+            perform_f_on_stack([=](State* state)
+            {
+                PINE_PROFILE_ZONE_TYPE("GameState::render", *state);
+                state->render(interpolation);
+            });
+
+            applyPendingChanges();
         }
 
-        /// Clears the GameStateStack
-        void clear()
+        /// Sets the pipeline used to hand snapshots of the GameStates to a render thread
+        /// \param pipeline The pipeline, or null to render on the calling thread
+        ///
+        /// Whilst the stack has a pipeline, GameStates that leave the stack are only
+        /// destroyed (or cached) once every snapshot they produced has been rendered.
+        void setRenderPipeline(RenderPipeline* pipeline)
         {
-            for(auto& listener : _listeners)
+            _pipeline = pipeline;
+            releaseRetiringStates();
+        }
+
+        /// \return The pipeline used to hand snapshots of the GameStates to a render thread (may be null)
+        RenderPipeline* getRenderPipeline() const { return _pipeline; }
+
+        /// Has the GameStates that would be rendered produce a snapshot of
+        /// the current frame, and hands it to the render thread
+        /// \param interpolation How far the game is between its previous
+        ///        and its next update, in the range [0, 1)
+        void produceSnapshots(Real interpolation)
+        {
+            PINE_PROFILE_ZONE("GameStateStack::produceSnapshots");
+            assert(_pipeline && "The stack does not have a render pipeline");
+
+            std::size_t slot = 0;
+            if(!_pipeline->beginProduce(slot)) return;
+
+            releaseRetiringStates();
+
+            auto& states = _snapshotStates[slot];
+            states.clear();
+            perform_f_on_stack([&](State* state)
             {
-                listener->onStackWillBeCleared(*this);
-            }
+                PINE_PROFILE_ZONE_TYPE("GameState::produceSnapshot", *state);
+                state->produceSnapshot(slot);
+                states.push_back(state);
+            });
 
-            _stack.clear();
+            _pipeline->endProduce(slot, interpolation);
+
+            applyPendingChanges();
         }
 
-        /// Removes a GameState from the stack
-        /// \param gameState The GameState you wish to remove
-        void remove(State* gameState)
+        /// Renders the snapshots in a slot of the pipeline, this is called on the render thread
+        /// \param slot The slot being rendered
+        /// \param interpolation How far the frame is between its previous and its next update
+        void consumeSnapshots(std::size_t slot, Real interpolation)
         {
-            assert(gameState);
+            PINE_PROFILE_ZONE("GameStateStack::consumeSnapshots");
 
-            auto elementToRemove = std::find_if(_stack.begin(), _stack.end(), [&](GameStatePair& p) { return p.first.get() == gameState; });
+            for(State* state : _snapshotStates[slot])
+            {
+                PINE_PROFILE_ZONE_TYPE("GameState::consumeSnapshot", *state);
+                state->consumeSnapshot(slot, interpolation);
+            }
+        }
 
-            if(elementToRemove == _stack.end())
-                return;
+        /// Keeps the state of the last ticks, so that the stack may be rewound to any of them
+        ///
+        /// Each tick, saveTick() records which GameStates are on the stack and copies
+        /// their state (see GameState::saveState) into a ring of buffers that are
+        /// allocated up front, so saving a tick does not allocate once the buffers
+        /// are large enough. The timers of the stack's timer wheel are saved with
+        /// each tick (see setTimerWheel). Whilst the window is enabled, GameStates
+        /// that leave the stack are kept alive until no saved tick refers to them.
+        ///
+        /// \param tickCount The amount of ticks to keep, 0 disables rollback
+        /// \param bytesPerTick The memory to reserve for each tick, in bytes
+        /// \see rewind, StatedGame::rollback
+        void setRollbackWindow(std::size_t tickCount, std::size_t bytesPerTick = 0)
+        {
+            assert(!isDeferringChanges() && "The rollback window cannot be changed whilst the stack is being iterated");
 
-            for(auto& listener : _listeners)
+            _savedTicks.clear();
+            _savedTicks.resize(tickCount);
+            for(auto& savedTick : _savedTicks)
             {
-                listener->onGameStateWillBeRemoved(*this, gameState);
+                savedTick.data.reserve(bytesPerTick);
             }
 
-            _stack.erase(elementToRemove);
+            releaseRemovedStates();
         }
 
+        /// \return The amount of ticks that are kept to rewind to
+        std::size_t getRollbackWindow() const { return _savedTicks.size(); }
 
-        /// \return The Game that the GameStack is connected to
-        Game& getGame() const { return *_game; }
+        /// \return The amount of times the stack has been updated (less the ticks it has been rewound by)
+        Tick getTick() const { return _tick; }
 
-        /// Adds a listener to the GameStateStack
-        /// \param listener The listener you wish to add to the game state stack
-        void addListener(Listener* listener)
+        /// Saves the state of the GameStates on the stack for the current tick,
+        /// this is called by StatedGame at the start of each update
+        void saveTick()
         {
-            assert(listener);
-            _listeners.push_back(listener);
+            PINE_PROFILE_ZONE("GameStateStack::saveTick");
+            assert(!_savedTicks.empty() && "The stack does not have a rollback window");
+
+            SavedTick& savedTick = _savedTicks[_tick % _savedTicks.size()];
+            savedTick.tick = _tick;
+            savedTick.states.clear();
+
+            std::size_t size = 0;
+            for(auto& entry : _stack)
+            {
+                std::size_t stateSize = entry.state->getSavedStateSize();
+                savedTick.states.push_back(SavedState{entry.state.get(), entry.slot, entry.pushType, size, stateSize, entry.ticksUntilUpdate, entry.pendingTime, entry.sleepTime});
+                size += aligned_size(stateSize);
+            }
+
+            if(savedTick.data.size() < size)
+            {
+                savedTick.data.resize(size);
+            }
+
+            for(auto& savedState : savedTick.states)
+            {
+                if(savedState.size > 0)
+                {
+                    savedState.state->saveState(savedTick.data.data() + savedState.offset);
+                }
+            }
+            if(_timers) _timers->save(savedTick.timers);
+            savedTick.isValid = true;
+
+            releaseRemovedStates();
         }
 
-        /// Removes a listener to the GameStateStack
-        /// \param listener The listener you wish to remove from the game state stack
-        void removeListener(Listener* listener)
+        /// \return The events routed in the current tick, which are kept with the tick so
+        ///         that they may be routed again when it is resimulated, or null if the
+        ///         current tick has not been saved (see saveTick)
+        ///
+        /// The events are left as they are until they are replaced, StatedGame replaces
+        /// them with the events it routes each tick, and routes them again whilst resimulating.
+        std::vector<GameEvent>* getSavedEvents()
         {
-            assert(listener);
-            _listeners.erase(std::remove(_listeners.begin(), _listeners.end(), listener), _listeners.end());
+            if(_savedTicks.empty()) return nullptr;
+
+            SavedTick& savedTick = _savedTicks[_tick % _savedTicks.size()];
+            return savedTick.isValid && savedTick.tick == _tick ? &savedTick.events : nullptr;
         }
 
-    private:
+        /// \return true if the stack can be rewound to a tick
+        bool canRewind(Tick tick) const
+        {
+            const SavedTick* savedTick = findSavedTick(tick);
+            if(!savedTick) return false;
 
+            // a GameState keeps its slot whilst it is on the stack, or kept for the saved ticks
+            for(auto& savedState : savedTick->states)
+            {
+                if(savedState.slot >= _slots.size() || _slots[savedState.slot].state != savedState.state)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
 
-        template <typename F>
-        void perform_f_on_stack(F f)
+        /// Rewinds the stack to how it was at the start of a tick
+        ///
+        /// The GameStates that were on the stack are put back in the order and with
+        /// the PushTypes they had, and their state is restored (see GameState::restoreState),
+        /// as is how far they are through their update rate, and the timer wheel's timers.
+        /// GameStates that were pushed since are taken off the stack. No GameState is
+        /// paused, resumed or started by rewinding, and listeners are only told that
+        /// the stack has changed (onStackChanged). The ticks after the tick are forgotten,
+        /// except for the events routed in them (see getSavedEvents).
+        ///
+        /// \param tick The tick to rewind to
+        /// \return true if the stack was rewound, false if the tick is not kept
+        /// \see StatedGame::rollback to update the game forward again
+        bool rewind(Tick tick)
         {
-            // we're going to loop through the stack backwards
-            // if the top is silently pushed on, we will iterate again
-            for(size_t i = _stack.size(); i-- > 0;)
+            PINE_PROFILE_ZONE("GameStateStack::rewind");
+            assert(!isDeferringChanges() && "The stack cannot be rewound whilst it is being iterated");
+
+            if(!canRewind(tick)) return false;
+
+            const SavedTick& savedTick = *findSavedTick(tick);
+
+            StackImpl stack;
+            stack.reserve(savedTick.states.size());
+            for(auto& savedState : savedTick.states)
             {
-                f(_stack[i].first.get());
+                // the entries that are moved are left empty, and are dropped below
+                StateSlot& slot = _slots[savedState.slot];
+                if(!slot.isRemoved)
+                {
+                    stack.push_back(std::move(_stack[slot.index]));
+                }
+                else
+                {
+                    // its handle was given up when it left the stack, it is alive again with a new handle
+                    stack.push_back(std::move(_removed[slot.index].entry));
+                    slot.isRemoved = false;
+                }
+                stack.back().pushType = savedState.pushType;
+                stack.back().ticksUntilUpdate = savedState.ticksUntilUpdate;
+                stack.back().pendingTime = savedState.pendingTime;
+                stack.back().sleepTime = savedState.sleepTime;
 
-                // if we no longer need to continue to iterate
-                if(_stack[i].second != PushType::PushWithoutPoppingSilenty)
+                if(savedState.size > 0)
                 {
-                    break;
+                    savedState.state->restoreState(savedTick.data.data() + savedState.offset);
                 }
             }
+
+            if(_timers) _timers->restore(savedTick.timers);
+
+            for(auto& saved : _savedTicks)
+            {
+                if(saved.tick > tick) saved.isValid = false;
+            }
+            _tick = tick;
+
+            _removed.erase(std::remove_if(_removed.begin(), _removed.end(), [](const RemovedState& r) { return !r.entry.state; }), _removed.end());
+            indexRemovedSlots();
+
+            // the GameStates pushed since the tick
+            stack.swap(_stack);
+            indexSlots(0);
+            for(auto& entry : stack)
+            {
+                if(entry.state) retire(entry);
+            }
+
+            for(auto& listener : _listeners)
+            {
+                listener->onStackChanged(*this);
+            }
+            return true;
         }
 
-        // utility class used to delete game states
-        struct GameStateDeleter
+        /// Clears the GameStateStack
+        void clear()
         {
-            void operator()(State* gameState) const
+            assertNotUpdatingIndependently();
+
+            if(isDeferringChanges())
             {
-                // unload resources
-                gameState->unloadResources();
+                _pendingChanges.push_back(StackChange{StackChange::Type::Clear});
+                return;
+            }
 
-                // delete the game state
-                delete gameState;
+            for(auto& listener : _listeners)
+            {
+                listener->onStackWillBeCleared(*this);
             }
-        };
 
-        typedef std::unique_ptr<State, GameStateDeleter> GameStatePtrImpl;
-        typedef std::pair<GameStatePtrImpl, PushType> GameStatePair;
-        typedef std::vector<GameStatePair> StackImpl;
-        typedef std::vector<Listener*> ListenerArray;
+            StackImpl stack;
+            stack.swap(_stack);
+            for(auto& entry : stack)
+            {
+                retire(entry);
+            }
+        }
+
+        /// Removes a GameState from the stack
+        /// \param gameState The GameState you wish to remove
+        void remove(State* gameState)
+        {
+            assert(gameState);
+            assertNotUpdatingIndependently();
 
+            if(isDeferringChanges())
+            {
+                StackChange change{StackChange::Type::Remove};
+                change.target = gameState;
+                _pendingChanges.push_back(std::move(change));
+                return;
+            }
 
-        /// Objecst that listen to game state events
-        ListenerArray _listeners;
+            auto elementToRemove = std::find_if(_stack.begin(), _stack.end(), [&](StackEntry& e) { return e.state.get() == gameState; });
 
-        /// The underlying stack implementation
-        StackImpl _stack;
+            if(elementToRemove == _stack.end())
+                return;
+
+            removeAt(static_cast<std::size_t>(elementToRemove - _stack.begin()));
+        }
+
+        /// Removes a GameState from the stack
+        ///
+        /// The GameState is found without searching the stack; only the
+        /// GameStates above it are moved down.
+        ///
+        /// \param handle The handle of the GameState you wish to remove
+        /// \return true if the GameState was removed (or will be, if the stack is
+        ///         being iterated), false if the handle is no longer alive or the
+        ///         GameState is still loading asynchronously
+        bool remove(GameStateHandle handle)
+        {
+            assertNotUpdatingIndependently();
+            if(!isAlive(handle)) return false;
+
+            const StateSlot& slot = _slots[handle.index];
+            if(slot.index == NONE && isLoading(*slot.state)) return false;
+
+            if(isDeferringChanges())
+            {
+                StackChange change{StackChange::Type::Remove};
+                change.target = slot.state;
+                _pendingChanges.push_back(std::move(change));
+                return true;
+            }
+
+            assert(slot.index != NONE && "Only a deferred push is not on the stack yet");
+            removeAt(slot.index);
+            return true;
+        }
+
+        /// \return true if a handle refers to a GameState that has not left the stack
+        ///
+        /// A GameState is alive from when it is pushed (including whilst it is loading
+        /// asynchronously, or its push is deferred) until it leaves the stack. A GameState
+        /// that the stack is rewound to (see rewind) is alive again, with a new handle.
+        bool isAlive(GameStateHandle handle) const
+        {
+            return handle.generation != 0 && handle.index < _slots.size() && _slots[handle.index].generation == handle.generation;
+        }
+
+        /// \return true if a handle refers to a GameState that is on the stack, i.e. it
+        ///         is alive, and has finished loading (if it was pushed asynchronously)
+        bool isOnStack(GameStateHandle handle) const
+        {
+            return isAlive(handle) && _slots[handle.index].index != NONE;
+        }
+
+        /// \return The GameState a handle refers to, or null if it is no longer alive
+        State* get(GameStateHandle handle) const
+        {
+            return isAlive(handle) ? _slots[handle.index].state : nullptr;
+        }
+
+        /// Applies the changes made to the stack whilst it was being iterated
+        ///
+        /// Pushing, popping, removing and clearing whilst the stack is updating
+        /// or rendering (e.g. a GameState pushing another GameState in its update())
+        /// is deferred until the stack has finished updating or rendering.
+        /// The deferred changes are then applied at once:
+        ///
+        /// - GameStates that are pushed then removed again are never started
+        /// - GameStates are only paused (or resumed) if they stop (or start) being
+        ///   updated once all the changes have been applied
+        /// - listeners are told about each change in the order it was made, with the
+        ///   same callback as if it had been made immediately (e.g. onStackWillBePopped
+        ///   for a pop), except for the GameStates that were pushed and removed again;
+        ///   then they are told onStackChanged
+        ///
+        /// This is called by update(), render() and activateLoadedStates().
+        void applyPendingChanges()
+        {
+            if(isDeferringChanges()) return;
+
+            while(!_pendingChanges.empty())
+            {
+                ChangeQueue changes;
+                changes.swap(_pendingChanges);
+
+                // changes made whilst applying are deferred to the next batch
+                ++_iterationDepth;
+                applyChanges(changes);
+                --_iterationDepth;
+            }
+        }
+
+        /// \return true if there are changes waiting to be applied
+        bool hasPendingChanges() const { return !_pendingChanges.empty(); }
+
+        /// Sets the budget of the cache, used by pushCached()
+        ///
+        /// The cache is disabled by default; whilst it is disabled, GameStates
+        /// pushed with pushCached() are destroyed when they leave the stack.
+        ///
+        /// \param maxCount The most GameStates that may be cached, 0 disables the cache
+        /// \param maxSize The most memory the cached GameStates' resources may use, in bytes
+        /// \see GameState::getResourceSize
+        void setCacheBudget(std::size_t maxCount, std::size_t maxSize = std::numeric_limits<std::size_t>::max())
+        {
+            _cacheMaxCount = maxCount;
+            _cacheMaxSize = maxSize;
+            trimCache();
+        }
+
+        /// Destroys every cached GameState
+        void clearCache()
+        {
+            while(!_cache.empty())
+            {
+                _cacheSize -= _cache.back().size;
+                _cache.pop_back();
+            }
+        }
+
+        /// \return The amount of cached GameStates
+        std::size_t getCachedCount() const { return _cache.size(); }
+
+        /// \return The amount of memory the cached GameStates' resources use, in bytes
+        std::size_t getCachedSize() const { return _cacheSize; }
+
+        /// \return Statistics on the cache
+        const StateCacheStats& getCacheStats() const { return _cacheStats; }
+
+
+        /// \return The Game that the GameStack is connected to
+        Game& getGame() const { return *_game; }
+
+        /// Adds a listener to the GameStateStack
+        /// \param listener The listener you wish to add to the game state stack
+        void addListener(Listener* listener)
+        {
+            assert(listener);
+            _listeners.push_back(listener);
+        }
+
+        /// Removes a listener to the GameStateStack
+        /// \param listener The listener you wish to remove from the game state stack
+        void removeListener(Listener* listener)
+        {
+            assert(listener);
+            _listeners.erase(std::remove(_listeners.begin(), _listeners.end(), listener), _listeners.end());
+        }
+
+    private:
+
+        template <typename F>
+        void perform_f_on_stack(F f)
+        {
+            perform_f_on_entries([&](StackEntry& entry) { f(entry.state.get()); });
+        }
+
+        template <typename F>
+        void perform_f_on_entries(F f)
+        {
+            // changes made to the stack whilst we iterate are deferred
+            ++_iterationDepth;
+
+            try
+            {
+                // we're going to loop through the stack backwards
+                // if the top is silently pushed on, we will iterate again
+                for(size_t i = _stack.size(); i-- > 0;)
+                {
+                    f(_stack[i]);
+
+                    // if we no longer need to continue to iterate
+                    if(_stack[i].pushType != PushType::PushWithoutPoppingSilenty)
+                    {
+                        break;
+                    }
+                }
+            }
+            catch(...)
+            {
+                --_iterationDepth;
+                throw;
+            }
+
+            --_iterationDepth;
+        }
+
+        bool isDeferringChanges() const { return _iterationDepth > 0; }
+
+        /// \return The index of the bottom-most GameState that is updated, in a stack of PushTypes
+        template <class TStack, class F>
+        static std::size_t first_active_index(const TStack& stack, F pushTypeOf)
+        {
+            for(std::size_t i = stack.size(); i-- > 0;)
+            {
+                if(pushTypeOf(stack[i]) != PushType::PushWithoutPoppingSilenty)
+                {
+                    return i;
+                }
+            }
+            return 0;
+        }
+
+        // utility class used to delete game states
+        struct GameStateDeleter
+        {
+            GameStateDeleter() :
+                allocator(nullptr),
+                memory(nullptr),
+                size(0),
+                alignment(0)
+            {
+            }
+
+            GameStateDeleter(StateAllocator* allocator, void* memory, std::size_t size, std::size_t alignment) :
+                allocator(allocator),
+                memory(memory),
+                size(size),
+                alignment(alignment)
+            {
+            }
+
+            void operator()(State* gameState) const
+            {
+                destroy(gameState, true);
+            }
+
+            void destroy(State* gameState, bool unloadResources) const
+            {
+                // unload resources
+                if(unloadResources)
+                {
+                    gameState->unloadResources();
+                }
+
+                // delete the game state
+                if(allocator)
+                {
+                    gameState->~State();
+                    allocator->deallocate(memory, size, alignment);
+                }
+                else
+                {
+                    delete gameState;
+                }
+            }
+
+            /// The allocator the game state was allocated with (null if it was allocated with new)
+            StateAllocator* allocator;
+
+            /// The memory, size and alignment the game state was allocated with
+            void* memory;
+            std::size_t size;
+            std::size_t alignment;
+        };
+
+        typedef std::unique_ptr<State, GameStateDeleter> GameStatePtrImpl;
+
+        // a GameState on the stack
+        struct StackEntry
+        {
+            StackEntry(GameStatePtrImpl state, PushType pushType, const std::type_info* cacheType = nullptr, const std::string& cacheKey = std::string()) :
+                state(std::move(state)),
+                pushType(pushType),
+                cacheType(cacheType),
+                cacheKey(cacheKey),
+                slot(NONE),
+                ticksUntilUpdate(0),
+                pendingTime(0),
+                sleepTime(0)
+            {
+            }
+
+            GameStatePtrImpl state;
+            PushType pushType;
+
+            /// The type and key the GameState is cached by (the type is null if it is not cacheable)
+            const std::type_info* cacheType;
+            std::string cacheKey;
+
+            /// The slot the GameState's handle refers to (NONE once it has left the stack,
+            /// unless it is kept for a saved tick, see RemovedState)
+            std::uint32_t slot;
+
+            /// How often the GameState is updated, the amount of ticks until it is next
+            /// updated (0 until it is scheduled), and the time it has skipped since
+            UpdateRate updateRate;
+            unsigned ticksUntilUpdate;
+            Seconds pendingTime;
+
+            /// The time the GameState sleeps for, counted by pendingTime (see GameState::sleepFor)
+            Seconds sleepTime;
+        };
+
+        // what a GameStateHandle refers to
+        struct StateSlot
+        {
+            State* state;
+
+            /// The GameState's index in the stack (NONE if it is not on the stack yet),
+            /// its index in the removed GameStates (if isRemoved), or the next free slot
+            /// whilst the slot is free
+            std::uint32_t index;
+
+            /// Incremented each time the slot is released, or its GameState is removed
+            std::uint32_t generation;
+
+            /// true whilst the GameState has left the stack, but is kept for the saved ticks
+            bool isRemoved;
+        };
+
+        // a GameState that has been suspended in the cache
+        struct CachedState
+        {
+            StackEntry entry;
+
+            /// The memory the GameState's resources use
+            std::size_t size;
+        };
+
+        // how a GameState is started when it is pushed on to the stack
+        enum class Activation
+        {
+            /// Load its resources and initialize it
+            Load,
+
+            /// Initialize it, its resources have already been loaded
+            Init,
+
+            /// Revive it from the cache
+            Revive
+        };
+
+        // a change to the stack that has been deferred
+        struct StackChange
+        {
+            enum class Type
+            {
+                Push,
+                Pop,
+                Remove,
+                Clear
+            };
+
+            explicit StackChange(Type type) :
+                type(type),
+                activation(Activation::Load),
+                target(nullptr)
+            {
+            }
+
+            Type type;
+
+            /// The GameState to push, and how it is started
+            std::unique_ptr<StackEntry> entry;
+            Activation activation;
+
+            /// The GameState to remove
+            State* target;
+        };
+
+        typedef std::deque<StackChange> ChangeQueue;
+
+        // a GameState that is due to be updated this tick
+        struct ScheduledUpdate
+        {
+            StackEntry* entry;
+
+            /// The amount of times it is updated, and the time each update is given
+            unsigned count;
+            Seconds time;
+
+            /// The exception its update threw, if it was updated as a job
+            std::exception_ptr error;
+        };
+
+        // a GameState that has left the stack, which may still be rendered
+        struct RetiringState
+        {
+            StackEntry entry;
+
+            /// The last frame the GameState may have produced a snapshot for
+            std::uint64_t lastFrame;
+        };
+
+        // a GameState that has left the stack, which a saved tick may refer to; it keeps
+        // its slot (which no handle refers to), so that rewind finds it by the slot
+        struct RemovedState
+        {
+            StackEntry entry;
+
+            /// The tick the GameState left the stack on
+            Tick removedTick;
+        };
+
+        // where a GameState's state was saved in a tick
+        struct SavedState
+        {
+            State* state;
+            std::uint32_t slot;
+            PushType pushType;
+            std::size_t offset;
+            std::size_t size;
+            unsigned ticksUntilUpdate;
+            Seconds pendingTime;
+            Seconds sleepTime;
+        };
+
+        // the state of the stack at the start of a tick
+        struct SavedTick
+        {
+            SavedTick() :
+                tick(0),
+                isValid(false)
+            {
+            }
+
+            Tick tick;
+            bool isValid;
+            std::vector<SavedState> states;
+            std::vector<unsigned char> data;
+
+            /// The timers of the game, if the stack has a timer wheel (see setTimerWheel)
+            TimerWheel::Snapshot timers;
+
+            /// The events routed in the tick, see getSavedEvents
+            std::vector<GameEvent> events;
+        };
+
+        typedef std::vector<StackEntry> StackImpl;
+        typedef std::list<CachedState> CacheImpl;
+        typedef std::vector<Listener*> ListenerArray;
+
+        // a GameState that is loading its resources in the background
+        struct LoadingGameState
+        {
+            GameStatePtrImpl state;
+            PushType pushType;
+            std::uint32_t slot;
+            std::future<void> loaded;
+            Real notifiedProgress;
+        };
+
+        typedef std::deque<LoadingGameState> LoadingQueue;
+
+        /// Constructs a GameState with the stack's allocator
+        /// \param args The arguments to construct the GameState with
+        template <class TGameState, class... Args>
+        GameStatePtrImpl makeState(Args&&... args)
+        {
+            if(!_allocator)
+            {
+                return GameStatePtrImpl{new TGameState{std::forward<Args>(args)...}};
+            }
+
+            void* memory = _allocator->allocate(sizeof(TGameState), alignof(TGameState));
+            TGameState* gameState;
+            try
+            {
+                gameState = new(memory) TGameState{std::forward<Args>(args)...};
+            }
+            catch(...)
+            {
+                _allocator->deallocate(memory, sizeof(TGameState), alignof(TGameState));
+                throw;
+            }
+
+            return GameStatePtrImpl{gameState, GameStateDeleter{_allocator, memory, sizeof(TGameState), alignof(TGameState)}};
+        }
+
+        GameStateHandle pushState(StackEntry entry, Activation activation)
+        {
+            assertNotUpdatingIndependently();
+            GameStateHandle handle = acquireSlot(entry);
+
+            if(isDeferringChanges())
+            {
+                StackChange change{StackChange::Type::Push};
+                change.entry.reset(new StackEntry(std::move(entry)));
+                change.activation = activation;
+                _pendingChanges.push_back(std::move(change));
+                return handle;
+            }
+
+            for(auto& listener : _listeners)
+            {
+                listener->onGameStateWillBePushed(*this, *entry.state);
+            }
+
+            activate(std::move(entry), activation);
+            return handle;
+        }
+
+        GameStateHandle pushStateAsync(GameStatePtrImpl gameStatePtr, PushType pushType)
+        {
+            assertNotUpdatingIndependently();
+            State* gameState = gameStatePtr.get();
+
+            for(auto& listener : _listeners)
+            {
+                listener->onGameStateWillBePushed(*this, *gameState);
+            }
+
+            gameState->_game = _game;
+
+            auto loaded = getLoader().enqueue([gameState]()
+            {
+                PINE_PROFILE_ZONE_TYPE("GameState::loadResources", *gameState);
+                gameState->loadResources();
+            });
+            std::uint32_t slot = acquireSlot(gameState);
+            _loading.push_back(LoadingGameState{std::move(gameStatePtr), pushType, slot, std::move(loaded), -1});
+            return GameStateHandle(slot, _slots[slot].generation);
+        }
+
+        /// Pushes a GameState on to the stack, and starts it
+        /// \param entry The GameState to push
+        /// \param activation How the GameState is started
+        void activate(StackEntry entry, Activation activation)
+        {
+            PushType pushType = entry.pushType;
+
+            switch(pushType)
+            {
+                case PushType::PushAndPop:
+                    pop();
+                    break;
+                case PushType::PushAndPopAllPreviousStates:
+                    clear();
+                    break;
+                default:
+                    break;
+            }
+
+            // if the stack isn't empty and we're not silently pushing
+            // then tell the stack we're gonna pause everyone
+            if(!_stack.empty() && pushType != PushType::PushWithoutPoppingSilenty)
+            {
+                perform_f_on_stack([](State* state) { state->onPause(); });
+            }
+
+            State* gameState = entry.state.get();
+            _stack.push_back(std::move(entry));
+            indexSlots(_stack.size() - 1);
+            schedule(_stack.back());
+            gameState->_game = _game;
+
+            if(activation == Activation::Revive)
+            {
+                gameState->onRevive();
+            }
+            else
+            {
+                // load resources
+                if(activation == Activation::Load)
+                {
+                    PINE_PROFILE_ZONE_TYPE("GameState::loadResources", *gameState);
+                    gameState->loadResources();
+                }
+
+                // initialize the state
+                gameState->init();
+            }
+
+            gameState->onResume();
+
+            for(auto& listener : _listeners)
+            {
+                listener->onGameStateWasPushed(*this, *gameState);
+            }
+        }
+
+        /// Throws away a change that will never be applied
+        void discard(StackChange& change)
+        {
+            if(!change.entry) return;
+
+            StackEntry& entry = *change.entry;
+            if(_timers) _timers->cancelAll(entry.state.get());
+            releaseSlot(entry.slot);
+
+            switch(change.activation)
+            {
+                case Activation::Revive:
+                {
+                    // it is still suspended, so it can go straight back in the cache
+                    std::size_t size = entry.state->getResourceSize();
+                    _cache.push_front(CachedState{std::move(entry), size});
+                    _cacheSize += size;
+                    trimCache();
+                    break;
+                }
+                case Activation::Load:
+                    // its resources were never loaded
+                    entry.state.get_deleter().destroy(entry.state.release(), false);
+                    break;
+                default:
+                    entry.state.reset();
+                    break;
+            }
+        }
+
+        /// Applies a batch of deferred changes, coalescing them
+        void applyChanges(ChangeQueue& changes)
+        {
+            // a GameState on the stack once the changes have been applied
+            struct Slot
+            {
+                StackEntry* entry;
+                State* state;
+                StackChange* change; // null if it was on the stack before the changes
+            };
+
+            std::vector<Slot> before;
+            for(auto& entry : _stack)
+            {
+                before.push_back(Slot{&entry, entry.state.get(), nullptr});
+            }
+
+            // what listeners are told, in the order the changes were made
+            struct Notice
+            {
+                typename StackChange::Type type;
+                State* state; // the GameState pushed or removed
+            };
+
+            // work out what the stack will look like
+            std::vector<Slot> after(before);
+            std::vector<Slot> removed;
+            std::vector<Notice> notices;
+            auto removeFrom = [&](typename std::vector<Slot>::iterator first, typename std::vector<Slot>::iterator last)
+            {
+                removed.insert(removed.end(), first, last);
+                after.erase(first, last);
+            };
+            auto pop = [&]()
+            {
+                if(!after.back().change) notices.push_back(Notice{StackChange::Type::Pop, after.back().state});
+                removeFrom(after.end() - 1, after.end());
+            };
+            auto clear = [&]()
+            {
+                notices.push_back(Notice{StackChange::Type::Clear, nullptr});
+                removeFrom(after.begin(), after.end());
+            };
+
+            for(auto& change : changes)
+            {
+                switch(change.type)
+                {
+                    case StackChange::Type::Push:
+                        if(change.entry->pushType == PushType::PushAndPop && !after.empty())
+                        {
+                            pop();
+                        }
+                        else if(change.entry->pushType == PushType::PushAndPopAllPreviousStates)
+                        {
+                            clear();
+                        }
+                        after.push_back(Slot{change.entry.get(), change.entry->state.get(), &change});
+                        notices.push_back(Notice{StackChange::Type::Push, change.entry->state.get()});
+                        break;
+                    case StackChange::Type::Pop:
+                        if(!after.empty())
+                        {
+                            pop();
+                        }
+                        break;
+                    case StackChange::Type::Remove:
+                    {
+                        auto slot = std::find_if(after.begin(), after.end(), [&](const Slot& s) { return s.state == change.target; });
+                        if(slot != after.end())
+                        {
+                            if(!slot->change) notices.push_back(Notice{StackChange::Type::Remove, slot->state});
+                            removeFrom(slot, slot + 1);
+                        }
+                        break;
+                    }
+                    case StackChange::Type::Clear:
+                        clear();
+                        break;
+                }
+            }
+
+            auto pushTypeOf = [](const Slot& slot) { return slot.entry->pushType; };
+            std::size_t firstActiveBefore = first_active_index(before, pushTypeOf);
+            std::size_t firstActiveAfter = first_active_index(after, pushTypeOf);
+            auto wasActive = [&](State* state)
+            {
+                for(std::size_t i = firstActiveBefore; i < before.size(); ++i)
+                {
+                    if(before[i].state == state) return true;
+                }
+                return false;
+            };
+            auto isActive = [&](State* state)
+            {
+                for(std::size_t i = firstActiveAfter; i < after.size(); ++i)
+                {
+                    if(after[i].state == state) return true;
+                }
+                return false;
+            };
+
+            // listeners are told about each change as if it had been made immediately,
+            // except for the GameStates that were pushed and removed again
+            auto isDiscarded = [&](State* state)
+            {
+                return std::find_if(removed.begin(), removed.end(), [&](const Slot& s) { return s.state == state; }) != removed.end();
+            };
+            for(auto& notice : notices)
+            {
+                for(auto& listener : _listeners)
+                {
+                    switch(notice.type)
+                    {
+                        case StackChange::Type::Push:
+                            if(!isDiscarded(notice.state)) listener->onGameStateWillBePushed(*this, *notice.state);
+                            break;
+                        case StackChange::Type::Pop:
+                            listener->onStackWillBePopped(*this);
+                            break;
+                        case StackChange::Type::Remove:
+                            listener->onGameStateWillBeRemoved(*this, *notice.state);
+                            break;
+                        case StackChange::Type::Clear:
+                            listener->onStackWillBeCleared(*this);
+                            break;
+                    }
+                }
+            }
+
+            // pause the GameStates that will no longer be updated
+            for(std::size_t i = before.size(); i-- > firstActiveBefore;)
+            {
+                State* state = before[i].state;
+                if(!isActive(state) && std::find_if(after.begin(), after.end(), [&](const Slot& s) { return s.state == state; }) != after.end())
+                {
+                    state->onPause();
+                }
+            }
+
+            // remove the GameStates that have left the stack, GameStates
+            // that were pushed and removed again are never started
+            for(auto& slot : removed)
+            {
+                if(slot.change)
+                {
+                    discard(*slot.change);
+                }
+                else
+                {
+                    StackEntry entry = std::move(*slot.entry);
+                    retire(entry);
+                }
+            }
+
+            StackImpl stack;
+            stack.reserve(after.size());
+            for(auto& slot : after)
+            {
+                stack.push_back(std::move(*slot.entry));
+            }
+            _stack.swap(stack);
+            indexSlots(0);
+            for(std::size_t i = 0; i < _stack.size(); ++i)
+            {
+                if(after[i].change) schedule(_stack[i]);
+            }
+
+            // start the GameStates that were pushed
+            for(auto& slot : after)
+            {
+                if(!slot.change) continue;
+
+                State* gameState = slot.state;
+                gameState->_game = _game;
+
+                if(slot.change->activation == Activation::Revive)
+                {
+                    gameState->onRevive();
+                }
+                else
+                {
+                    if(slot.change->activation == Activation::Load)
+                    {
+                        PINE_PROFILE_ZONE_TYPE("GameState::loadResources", *gameState);
+                        gameState->loadResources();
+                    }
+                    gameState->init();
+                }
+            }
+
+            // resume the GameStates that will now be updated
+            for(std::size_t i = after.size(); i-- > firstActiveAfter;)
+            {
+                State* state = after[i].state;
+                if(after[i].change || !wasActive(state))
+                {
+                    state->onResume();
+                }
+            }
+
+            for(auto& listener : _listeners)
+            {
+                for(auto& slot : after)
+                {
+                    if(slot.change)
+                    {
+                        listener->onGameStateWasPushed(*this, *slot.state);
+                    }
+                }
+                listener->onStackChanged(*this);
+            }
+        }
+
+        /// Keeps a GameState that has left the stack whilst a saved tick may refer to it,
+        /// and releases it otherwise
+        /// \param entry The GameState that has left the stack
+        void retire(StackEntry& entry)
+        {
+            // the timers are restored with the saved ticks, if the stack is rewound
+            if(_timers) _timers->cancelAll(entry.state.get());
+
+            if(!_savedTicks.empty())
+            {
+                // its handle is no longer alive, but it keeps its slot for rewind to find it by
+                StateSlot& slot = _slots[entry.slot];
+                if(++slot.generation == 0) slot.generation = 1;
+                slot.index = static_cast<std::uint32_t>(_removed.size());
+                slot.isRemoved = true;
+
+                _removed.push_back(RemovedState{std::move(entry), _tick});
+                return;
+            }
+
+            releaseSlot(entry.slot);
+            release(entry);
+        }
+
+        /// Asks a GameState that has been pushed on the stack for its update rate, and
+        /// picks the tick it is first updated on, within its period, as the tick that
+        /// the fewest other GameStates that are not updated every tick are updated on
+        void schedule(StackEntry& entry)
+        {
+            entry.updateRate = entry.state->getUpdateRate();
+            entry.pendingTime = 0;
+            entry.sleepTime = 0;
+            entry.ticksUntilUpdate = 0;
+
+            unsigned period = entry.updateRate.ticksPerUpdate;
+            unsigned bestTicks = 1;
+            std::size_t bestCount = std::numeric_limits<std::size_t>::max();
+            for(unsigned ticks = 1; ticks <= period && bestCount > 0 && period > 1; ++ticks)
+            {
+                std::size_t count = 0;
+                for(auto& other : _stack)
+                {
+                    unsigned otherPeriod = other.updateRate.ticksPerUpdate;
+                    if(otherPeriod > 1 && other.ticksUntilUpdate > 0 && ticks >= other.ticksUntilUpdate && (ticks - other.ticksUntilUpdate) % otherPeriod == 0)
+                    {
+                        ++count;
+                    }
+                }
+
+                if(count < bestCount)
+                {
+                    bestTicks = ticks;
+                    bestCount = count;
+                }
+            }
+            entry.ticksUntilUpdate = bestTicks;
+        }
+
+        /// Counts a tick towards a GameState's update rate
+        /// \param deltaTime The time of the tick
+        /// \param updateTime The time each update is given
+        /// \return The amount of times the GameState is updated this tick
+        static unsigned advanceSchedule(StackEntry& entry, Seconds deltaTime, Seconds& updateTime)
+        {
+            entry.pendingTime += deltaTime;
+            if(--entry.ticksUntilUpdate > 0) return 0;
+
+            const UpdateRate& rate = entry.updateRate;
+            entry.ticksUntilUpdate = rate.ticksPerUpdate;
+
+            // the time slept through is handed to the GameState once it wakes
+            if(entry.pendingTime < entry.sleepTime) return 0;
+            entry.sleepTime = 0;
+
+            updateTime = entry.pendingTime / rate.updatesPerTick;
+            entry.pendingTime = 0;
+            return rate.updatesPerTick;
+        }
+
+        /// Updates a GameState, and has it sleep if it asked to (see GameState::sleepFor)
+        /// \param updateCount The amount of times to update it, the rest are skipped if it falls asleep
+        /// \param updateTime The time each update is given
+        static void updateState(StackEntry& entry, unsigned updateCount, Seconds updateTime)
+        {
+            State* state = entry.state.get();
+            PINE_PROFILE_ZONE_TYPE("GameState::update", *state);
+
+            for(unsigned i = 0; i < updateCount; ++i)
+            {
+                state->update(updateTime);
+                if(state->_sleepTime > 0)
+                {
+                    // the updates skipped in this tick count towards the sleep
+                    entry.pendingTime += updateTime * (updateCount - i - 1);
+                    entry.sleepTime = state->_sleepTime;
+                    state->_sleepTime = 0;
+                    break;
+                }
+            }
+        }
+
+        /// Removes the GameState at an index of the stack
+        void removeAt(std::size_t index)
+        {
+            for(auto& listener : _listeners)
+            {
+                listener->onGameStateWillBeRemoved(*this, *_stack[index].state);
+            }
+
+            StackEntry entry = std::move(_stack[index]);
+            _stack.erase(_stack.begin() + index);
+            indexSlots(index);
+            retire(entry);
+        }
+
+        /// Gives a GameState a handle
+        /// \return The slot the handle refers to
+        std::uint32_t acquireSlot(State* gameState)
+        {
+            std::uint32_t index = _freeSlot;
+            if(index == NONE)
+            {
+                assert(_slots.size() < NONE && "Too many GameStates");
+                _slots.push_back(StateSlot{nullptr, NONE, 1, false});
+                index = static_cast<std::uint32_t>(_slots.size() - 1);
+            }
+            else
+            {
+                _freeSlot = _slots[index].index;
+            }
+
+            _slots[index].state = gameState;
+            _slots[index].index = NONE;
+            return index;
+        }
+
+        GameStateHandle acquireSlot(StackEntry& entry)
+        {
+            entry.slot = acquireSlot(entry.state.get());
+            return GameStateHandle(entry.slot, _slots[entry.slot].generation);
+        }
+
+        /// Takes a GameState's handle away, so that the handle is no longer alive
+        void releaseSlot(std::uint32_t& index)
+        {
+            if(index == NONE) return;
+
+            StateSlot& slot = _slots[index];
+            slot.state = nullptr;
+            if(++slot.generation == 0) slot.generation = 1;
+            slot.isRemoved = false;
+            slot.index = _freeSlot;
+            _freeSlot = index;
+            index = NONE;
+        }
+
+        /// Updates the index that the slots of the GameStates on the stack, from an index up, refer to
+        void indexSlots(std::size_t first)
+        {
+            for(std::size_t i = first; i < _stack.size(); ++i)
+            {
+                _slots[_stack[i].slot].index = static_cast<std::uint32_t>(i);
+            }
+        }
+
+        /// Updates the index that the slots of the removed GameStates refer to
+        void indexRemovedSlots()
+        {
+            for(std::size_t i = 0; i < _removed.size(); ++i)
+            {
+                _slots[_removed[i].entry.slot].index = static_cast<std::uint32_t>(i);
+            }
+        }
+
+        /// Releases the GameStates that left the stack before the oldest saved tick
+        void releaseRemovedStates()
+        {
+            Tick oldestTick = _tick + 1 >= _savedTicks.size() ? _tick + 1 - _savedTicks.size() : 0;
+
+            auto isReleased = [&](const RemovedState& removed) { return _savedTicks.empty() || removed.removedTick < oldestTick; };
+            bool hasReleased = false;
+            for(auto& removed : _removed)
+            {
+                if(isReleased(removed))
+                {
+                    releaseSlot(removed.entry.slot);
+                    release(removed.entry);
+                    hasReleased = true;
+                }
+            }
+
+            if(!hasReleased) return;
+            _removed.erase(std::remove_if(_removed.begin(), _removed.end(), [](const RemovedState& r) { return r.entry.slot == NONE; }), _removed.end());
+            indexRemovedSlots();
+        }
+
+        /// \return The saved tick, or null if it is not kept
+        const SavedTick* findSavedTick(Tick tick) const
+        {
+            if(_savedTicks.empty()) return nullptr;
+
+            const SavedTick& savedTick = _savedTicks[tick % _savedTicks.size()];
+            return savedTick.isValid && savedTick.tick == tick ? &savedTick : nullptr;
+        }
+
+        /// \return The size of a GameState's saved state, rounded up so that the next one is aligned
+        static std::size_t aligned_size(std::size_t size)
+        {
+            const std::size_t alignment = alignof(std::max_align_t);
+            return (size + alignment - 1) / alignment * alignment;
+        }
+
+        /// Destroys a GameState that has left the stack, or suspends it in the cache,
+        /// once the render thread no longer uses it
+        /// \param entry The GameState that has left the stack
+        void release(StackEntry& entry)
+        {
+            if(_pipeline)
+            {
+                _retiring.push_back(RetiringState{std::move(entry), _pipeline->getLastFrame()});
+                return;
+            }
+
+            destroyOrSuspend(entry);
+        }
+
+        /// Retires the GameStates that are no longer used by the render thread
+        void releaseRetiringStates()
+        {
+            std::uint64_t oldestFrame = _pipeline ? _pipeline->getOldestFrameInFlight() : std::numeric_limits<std::uint64_t>::max();
+
+            auto isReleased = [&](const RetiringState& retiring) { return retiring.lastFrame < oldestFrame; };
+            for(auto& retiring : _retiring)
+            {
+                if(isReleased(retiring))
+                {
+                    destroyOrSuspend(retiring.entry);
+                }
+            }
+            _retiring.erase(std::remove_if(_retiring.begin(), _retiring.end(), isReleased), _retiring.end());
+        }
+
+        /// Destroys a GameState that has left the stack, or suspends it in the cache
+        /// \param entry The GameState that has left the stack
+        void destroyOrSuspend(StackEntry& entry)
+        {
+            if(!entry.cacheType || _cacheMaxCount == 0)
+            {
+                entry.state.reset();
+                return;
+            }
+
+            entry.state->onSuspend();
+
+            std::size_t size = entry.state->getResourceSize();
+            _cache.push_front(CachedState{std::move(entry), size});
+            _cacheSize += size;
+
+            trimCache();
+        }
+
+        /// Evicts the least recently used GameStates, until the cache is within its budget
+        void trimCache()
+        {
+            while(!_cache.empty() && (_cache.size() > _cacheMaxCount || _cacheSize > _cacheMaxSize))
+            {
+                _cacheSize -= _cache.back().size;
+                _cache.pop_back();
+                ++_cacheStats.evictionCount;
+            }
+        }
+
+        /// \return The thread pool used to load GameStates asynchronously
+        ThreadPool& getLoader()
+        {
+            if(_sharedLoader) return *_sharedLoader;
+
+            if(!_loader)
+            {
+                _loader.reset(new ThreadPool(_loaderThreadCount));
+            }
+            return *_loader;
+        }
+
+        /// \return The job system used to update independent GameStates
+        JobSystem& getUpdater()
+        {
+            if(_sharedUpdater) return *_sharedUpdater;
+
+            if(!_updater)
+            {
+                _updater.reset(new JobSystem(_updaterThreadCount));
+            }
+            return *_updater;
+        }
+
+        /// Updates a GameState with an independent update, as a job of the updater
+        void updateIndependently(ScheduledUpdate& update)
+        {
+            const ThisType*& updatingStack = independentlyUpdatedStack();
+            const ThisType* outerStack = updatingStack;
+            updatingStack = this;
+
+            // the exception is kept rather than thrown, so that the updater's
+            // frame (see JobSystem::waitForFrame) does not throw it a second time
+            try
+            {
+                updateState(*update.entry, update.count, update.time);
+            }
+            catch(...)
+            {
+                update.error = std::current_exception();
+            }
+
+            updatingStack = outerStack;
+        }
+
+        /// Waits for the GameStates being updated as jobs of the updater
+        /// \return The first exception that occurred whilst updating, if any
+        std::exception_ptr joinUpdates()
+        {
+            if(_independentUpdates.empty()) return nullptr;
+
+            getUpdater().wait(_updating);
+            _updating = JobHandle();
+
+            for(auto& update : _independentUpdates)
+            {
+                if(update.error) return update.error;
+            }
+            return nullptr;
+        }
+
+        /// \return The stack whose independent GameState is being updated on the calling thread (null if none)
+        static const ThisType*& independentlyUpdatedStack()
+        {
+            static thread_local const ThisType* stack = nullptr;
+            return stack;
+        }
+
+        /// Asserts that the stack is not changed by a GameState with an independent update, which may
+        /// be updated on another thread whilst the stack is iterated (see update)
+        void assertNotUpdatingIndependently() const
+        {
+            assert(independentlyUpdatedStack() != this && "A GameState with an independent update must not change the stack");
+        }
+
+
+        /// Objecst that listen to game state events
+        ListenerArray _listeners;
+
+        /// The underlying stack implementation
+        StackImpl _stack;
+
+        /// GameStates that are loading asynchronously, in the order they were pushed
+        LoadingQueue _loading;
+
+        /// Changes to the stack that have been deferred whilst it is being iterated
+        ChangeQueue _pendingChanges;
+
+        /// How many times the stack is being iterated over
+        unsigned _iterationDepth;
+
+        /// Suspended GameStates, the most recently used first
+        CacheImpl _cache;
+
+        /// The memory used by the resources of the cached GameStates
+        std::size_t _cacheSize;
+
+        /// The budget of the cache
+        std::size_t _cacheMaxCount;
+        std::size_t _cacheMaxSize;
+
+        StateCacheStats _cacheStats;
+
+        /// The threads used to load GameStates asynchronously (created on demand)
+        std::unique_ptr<ThreadPool> _loader;
+
+        /// The threads used to load GameStates asynchronously, if they are shared with other stacks (may be null)
+        ThreadPool* _sharedLoader;
+
+        /// The amount of threads the loader is created with
+        std::size_t _loaderThreadCount;
+
+        /// The jobs used to update independent GameStates (created on demand)
+        std::unique_ptr<JobSystem> _updater;
+
+        /// The jobs used to update independent GameStates, if they are shared (e.g. the engine's, may be null)
+        JobSystem* _sharedUpdater;
+
+        /// The GameStates updated this tick on the calling thread, and as jobs of the updater
+        /// (kept between ticks, so that they are not allocated each tick)
+        std::vector<ScheduledUpdate> _updates;
+        std::vector<ScheduledUpdate> _independentUpdates;
+
+        /// The job updating the independent GameStates
+        JobHandle _updating;
+
+        /// The amount of threads the updater is created with
+        std::size_t _updaterThreadCount;
+
+        /// Hands snapshots of the GameStates to the render thread (may be null)
+        RenderPipeline* _pipeline;
+
+        /// The GameStates that produced the snapshots in each slot of the pipeline
+        std::vector<State*> _snapshotStates[RenderPipeline::maxBufferCount()];
+
+        /// GameStates that have left the stack, whose snapshots may still be rendered
+        std::vector<RetiringState> _retiring;
+
+        /// The state of the last ticks, a ring indexed by tick (empty if rollback is disabled)
+        std::vector<SavedTick> _savedTicks;
+
+        /// GameStates that have left the stack, which the saved ticks may refer to
+        std::vector<RemovedState> _removed;
+
+        /// The amount of times the stack has been updated
+        Tick _tick;
+
+        /// The timers the GameStates bind their timers to (may be null)
+        TimerWheel* _timers;
+
+        /// What the handles of the GameStates refer to, a slot is reused once it has been released
+        std::vector<StateSlot> _slots;
+
+        /// The first free slot
+        std::uint32_t _freeSlot;
+
+        static const std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+
+        /// Allocates the GameStates constructed by the stack (null to use new)
+        StateAllocator* _allocator;
 
         /// The game attached to the stack
         Game* _game;
@@ -0,0 +1,166 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_HEADLESS_RUNNER_HPP
+#define PINE_HEADLESS_RUNNER_HPP
+
+#include <type_traits>
+
+#include <cassert>
+
+#include <pine/Types.hpp>
+#include <pine/Game.hpp>
+#include <pine/Clock.hpp>
+#include <pine/LoopPolicy.hpp>
+
+namespace pine
+{
+    namespace detail
+    {
+        // forwards updates to a game, counting them
+        template <class TGame>
+        struct TickCounter
+        {
+            void update(Seconds deltaTime)
+            {
+                game.update(deltaTime);
+                ++tickCount;
+            }
+
+            GameLoad& getLoad() { return game.getLoad(); }
+
+            TGame& game;
+            Tick& tickCount;
+        };
+    }
+
+    /// \brief Runs a game on a virtual clock, as fast as possible
+    ///
+    /// Each frame advances a virtual clock without waiting, by either
+    /// exactly the time until the next update is due, or by a fixed
+    /// frame time. The game sees the same delta times as it would
+    /// in real time, thus simulations, bots and tests may be run many
+    /// times faster than real time.
+    ///
+    /// The game must be initialized (and have its engine set) before it is run.
+    ///
+    /// \tparam TLoopPolicy Decides how the game is updated each frame, see LoopPolicy.hpp
+    /// \author Miguel Martin
+    template <class TLoopPolicy = FixedTimeStep<> >
+    class HeadlessRunner
+    {
+    public:
+
+        /// \param frameTime The time that passes each frame, or 0 to advance
+        ///        until the next update of the loop policy is due
+        explicit HeadlessRunner(Nanoseconds frameTime = 0) :
+            _frameTime(frameTime),
+            _tickCount(0)
+        {
+            assert(frameTime >= 0 && "Frame time must not be negative");
+        }
+
+        /// Runs a single frame
+        /// \param game The game to run
+        template <class TGame>
+        void runFrame(TGame& game)
+        {
+            static_assert(std::is_base_of<detail::GameType, TGame>::value, "Game is not a GameType");
+
+            detail::TickCounter<TGame> counter = { game, _tickCount };
+            Nanoseconds frameTime = _frameTime > 0 ? _frameTime : _loop.timeUntilNextTick();
+            assert(frameTime > 0 && "A frame time must be given for loop policies that update every frame");
+
+            game.frameStart();
+            _clock.advance(frameTime);
+            Real interpolation = _loop.advance(counter, frameTime);
+            game.frameEnd(interpolation);
+        }
+
+        /// Runs frames until the game has been updated a number of times, or has quit
+        /// \param game The game to run
+        /// \param tickCount The amount of updates to run
+        /// \return The amount of updates that were run
+        template <class TGame>
+        Tick runTicks(TGame& game, Tick tickCount)
+        {
+            Tick startTickCount = _tickCount;
+            while(game.isRunning() && _tickCount - startTickCount < tickCount)
+            {
+                runFrame(game);
+            }
+            return _tickCount - startTickCount;
+        }
+
+        /// Runs frames for an amount of simulated time, or until the game has quit
+        /// \param game The game to run
+        /// \param duration The amount of simulated time to run for
+        /// \return The amount of frames that were run
+        template <class TGame>
+        std::size_t runFor(TGame& game, Nanoseconds duration)
+        {
+            Nanoseconds endTime = _clock.now() + duration;
+            std::size_t frameCount = 0;
+            for(; _clock.now() < endTime && game.isRunning(); ++frameCount)
+            {
+                runFrame(game);
+            }
+            return frameCount;
+        }
+
+        /// \return The virtual clock the game is run on
+        const VirtualClock& getClock() const { return _clock; }
+
+        /// \return The amount of updates that have been run
+        Tick getTickCount() const { return _tickCount; }
+
+        /// \return The time that passes each frame, or 0 if frames advance until the next update
+        Nanoseconds getFrameTime() const { return _frameTime; }
+
+    private:
+
+        TLoopPolicy _loop;
+        VirtualClock _clock;
+        Nanoseconds _frameTime;
+        Tick _tickCount;
+    };
+
+    /// Runs a game on a virtual clock, as fast as possible
+    /// \tparam TLoopPolicy Decides how the game is updated each frame, see LoopPolicy.hpp
+    /// \param game The game to run (must already be initialized)
+    /// \param tickCount The amount of updates to run
+    /// \return The amount of updates that were run
+    template <class TLoopPolicy = FixedTimeStep<>, class TGame>
+    Tick runTicks(TGame& game, Tick tickCount)
+    {
+        HeadlessRunner<TLoopPolicy> runner;
+        return runner.runTicks(game, tickCount);
+    }
+}
+
+#endif // PINE_HEADLESS_RUNNER_HPP
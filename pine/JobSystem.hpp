@@ -0,0 +1,673 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_JOB_SYSTEM_HPP
+#define PINE_JOB_SYSTEM_HPP
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <condition_variable>
+
+#include <cassert>
+
+#include <pine/ThreadPool.hpp>
+#include <pine/Profiler.hpp>
+
+namespace pine
+{
+    class JobSystem;
+
+    namespace detail
+    {
+        struct Job;
+        class JobPool;
+
+        /// A counted reference to a job, the job is returned to its pool once it is no longer referred to
+        class JobRef
+        {
+        public:
+
+            JobRef() : _job(nullptr) { }
+
+            /// \param job A job whose reference the JobRef takes over
+            explicit JobRef(Job* job) : _job(job) { }
+
+            JobRef(const JobRef& other);
+            JobRef(JobRef&& other) noexcept : _job(other._job) { other._job = nullptr; }
+
+            JobRef& operator=(JobRef other)
+            {
+                std::swap(_job, other._job);
+                return *this;
+            }
+
+            ~JobRef() { reset(); }
+
+            void reset();
+
+            Job* get() const { return _job; }
+            Job* operator->() const { return _job; }
+            explicit operator bool() const { return _job != nullptr; }
+
+        private:
+
+            Job* _job;
+        };
+
+        struct Job
+        {
+            Job() :
+                unfinished(1),
+                waitingFor(1),
+                isFinished(false),
+                references(0),
+                pool(nullptr)
+            {
+            }
+
+            /// Readies the job to be handed out by its pool again
+            void reset()
+            {
+                task = nullptr;
+                parent.reset();
+                unfinished.store(1, std::memory_order_relaxed);
+                waitingFor.store(1, std::memory_order_relaxed);
+                dependents.clear();
+                isFinished = false;
+                error = nullptr;
+            }
+
+            /// The work to do, empty for a job that groups other jobs
+            std::function<void()> task;
+
+            /// The job that groups this job (may be null)
+            JobRef parent;
+
+            /// The amount of unfinished work in this job, and the jobs it groups
+            std::atomic<std::size_t> unfinished;
+
+            /// The amount of jobs this job depends on that are unfinished, plus one
+            /// whilst the job is being scheduled
+            std::atomic<std::size_t> waitingFor;
+
+            /// Guards dependents, isFinished and error
+            std::mutex mutex;
+
+            /// Jobs that depend on this job
+            std::vector<JobRef> dependents;
+
+            bool isFinished;
+
+            /// The first exception thrown by the job, or the jobs it groups
+            std::exception_ptr error;
+
+            /// The amount of JobRefs referring to the job
+            std::atomic<std::size_t> references;
+
+            /// The pool the job is returned to
+            JobPool* pool;
+        };
+
+        /// Keeps the jobs of a JobSystem, which are allocated in blocks and reused
+        /// once they are no longer referred to, rather than allocated for each job
+        class JobPool
+        {
+        public:
+
+            /// The amount of jobs allocated at once
+            static const std::size_t BLOCK_SIZE = 64;
+
+            /// \return A job that is ready to be scheduled
+            JobRef acquire()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if(_free.empty())
+                {
+                    _blocks.emplace_back(new Job[BLOCK_SIZE]);
+                    for(std::size_t i = BLOCK_SIZE; i-- > 0;)
+                    {
+                        _blocks.back()[i].pool = this;
+                        _free.push_back(&_blocks.back()[i]);
+                    }
+                }
+
+                Job* job = _free.back();
+                _free.pop_back();
+                job->references.store(1, std::memory_order_relaxed);
+                return JobRef(job);
+            }
+
+            /// Returns a job that is no longer referred to
+            void release(Job* job)
+            {
+                // the job's parent and dependents are released before the pool is locked
+                job->reset();
+
+                std::lock_guard<std::mutex> lock(_mutex);
+                _free.push_back(job);
+            }
+
+        private:
+
+            std::mutex _mutex;
+            std::vector<std::unique_ptr<Job[]> > _blocks;
+            std::vector<Job*> _free;
+        };
+
+        inline JobRef::JobRef(const JobRef& other) :
+            _job(other._job)
+        {
+            if(_job) _job->references.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        inline void JobRef::reset()
+        {
+            Job* job = _job;
+            _job = nullptr;
+            if(job && job->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                job->pool->release(job);
+            }
+        }
+    }
+
+    /// \brief A handle to a job scheduled on a JobSystem
+    ///
+    /// A default constructed handle refers to no job, and is always finished.
+    /// A handle must not outlive the JobSystem its job was scheduled on.
+    ///
+    /// \author Miguel Martin
+    class JobHandle
+    {
+    public:
+
+        friend class JobSystem;
+
+        JobHandle() = default;
+
+        /// \return true if the job (and every job it groups) has finished
+        bool isFinished() const
+        {
+            if(!_job) return true;
+
+            std::lock_guard<std::mutex> lock(_job->mutex);
+            return _job->isFinished;
+        }
+
+    private:
+
+        explicit JobHandle(detail::JobRef job) : _job(std::move(job)) {}
+
+        detail::JobRef _job;
+    };
+
+    /// \brief A work-stealing job scheduler
+    ///
+    /// Each worker thread has its own queue of jobs; a worker runs the jobs it
+    /// scheduled itself most recently first, and steals the oldest jobs from
+    /// the other queues when its own queue is empty. Jobs scheduled by other
+    /// threads (such as the game loop) are placed in a shared queue.
+    ///
+    /// Jobs may depend on other jobs, in which case they are only run once
+    /// those jobs have finished. A thread that waits for a job runs other jobs
+    /// whilst it waits, so a JobSystem without worker threads runs its jobs
+    /// on whichever thread waits for them.
+    ///
+    /// The worker threads are only started once the first job is scheduled, so
+    /// a JobSystem that is never used costs no threads. The jobs are kept in a
+    /// pool, and reused once they have finished and no handle refers to them.
+    ///
+    /// \author Miguel Martin
+    class JobSystem
+    {
+    public:
+
+        /// \param threadCount The amount of worker threads to spawn, once the first job is scheduled
+        explicit JobSystem(std::size_t threadCount = ThreadPool::defaultThreadCount()) :
+            _queues(new Queue[threadCount + 1]),
+            _queueCount(threadCount + 1),
+            _queuedCount(0),
+            _frameUnfinished(0),
+            _threadCount(threadCount),
+            _hasStartedThreads(false),
+            _isStopping(false)
+        {
+        }
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        /// Finishes all scheduled jobs and joins the worker threads
+        ~JobSystem()
+        {
+            try
+            {
+                waitForFrame();
+            }
+            catch(...)
+            {
+                // nobody is left to handle the exception
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_sleepMutex);
+                _isStopping = true;
+            }
+            _wakeCondition.notify_all();
+
+            std::lock_guard<std::mutex> lock(_workersMutex);
+            for(auto& worker : _workers)
+            {
+                worker.join();
+            }
+        }
+
+        /// Schedules a job
+        /// \param task The work to do
+        /// \return A handle to the job
+        template <class F>
+        JobHandle schedule(F task)
+        {
+            return schedule(std::move(task), {});
+        }
+
+        /// Schedules a job, that is run once other jobs have finished
+        /// \param task The work to do
+        /// \param dependencies The jobs that must finish before the job is run
+        /// \return A handle to the job
+        template <class F>
+        JobHandle schedule(F task, std::initializer_list<JobHandle> dependencies)
+        {
+            return schedule(std::move(task), dependencies.begin(), dependencies.end());
+        }
+
+        /// Schedules a job, that is run once other jobs have finished
+        /// \param task The work to do
+        /// \param dependencies The jobs that must finish before the job is run
+        /// \return A handle to the job
+        template <class F>
+        JobHandle schedule(F task, const std::vector<JobHandle>& dependencies)
+        {
+            return schedule(std::move(task), dependencies.begin(), dependencies.end());
+        }
+
+        /// Schedules f(i) for every i in [begin, end), split into jobs of grainSize indices
+        /// \param begin The first index
+        /// \param end One past the last index
+        /// \param grainSize The amount of indices each job handles
+        /// \param f The function to call with each index
+        /// \param dependencies The jobs that must finish before any index is handled
+        /// \return A handle that is finished once every index has been handled
+        template <class F>
+        JobHandle parallelFor(std::size_t begin, std::size_t end, std::size_t grainSize, F f,
+                              std::initializer_list<JobHandle> dependencies = {})
+        {
+            assert(grainSize > 0 && "The grain size must be at least one");
+
+            detail::JobRef group = _pool.acquire();
+            if(begin >= end)
+            {
+                group->isFinished = true;
+                return JobHandle{group};
+            }
+
+            std::size_t jobCount = (end - begin + grainSize - 1) / grainSize;
+            group->unfinished.store(jobCount, std::memory_order_relaxed);
+
+            for(std::size_t first = begin; first < end; first += grainSize)
+            {
+                std::size_t last = end - first > grainSize ? first + grainSize : end;
+
+                detail::JobRef job = makeJob([f, first, last]()
+                {
+                    for(std::size_t i = first; i < last; ++i)
+                    {
+                        f(i);
+                    }
+                });
+                job->parent = group;
+                submit(job, dependencies.begin(), dependencies.end());
+            }
+
+            return JobHandle{group};
+        }
+
+        /// Waits for a job to finish, running other jobs whilst waiting
+        /// \param job The job to wait for
+        /// \note Any exception thrown by the job is re-thrown
+        void wait(const JobHandle& job)
+        {
+            PINE_PROFILE_ZONE("JobSystem::wait");
+
+            while(!job.isFinished())
+            {
+                if(!runOne())
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            if(job._job && job._job->error)
+            {
+                std::rethrow_exception(job._job->error);
+            }
+        }
+
+        /// Waits for every job scheduled so far to finish, running jobs whilst waiting
+        /// This is called at the end of every frame by the Engine that owns the JobSystem.
+        /// \note The first exception thrown by a job since the last call is re-thrown
+        void waitForFrame()
+        {
+            PINE_PROFILE_ZONE("JobSystem::waitForFrame");
+
+            while(_frameUnfinished.load(std::memory_order_acquire) > 0)
+            {
+                if(!runOne())
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            std::exception_ptr error;
+            {
+                std::lock_guard<std::mutex> lock(_frameErrorMutex);
+                std::swap(error, _frameError);
+            }
+            if(error) std::rethrow_exception(error);
+        }
+
+        /// \return The amount of worker threads (which may not have been started yet)
+        std::size_t getThreadCount() const { return _threadCount; }
+
+        /// \return true once the worker threads have been started
+        bool hasStartedThreads() const { return _hasStartedThreads.load(std::memory_order_acquire); }
+
+    private:
+
+        typedef detail::JobRef JobPtr;
+
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<JobPtr> jobs;
+        };
+
+        /// The queue the calling thread schedules its jobs on
+        struct ThreadQueue
+        {
+            JobSystem* owner;
+            std::size_t index;
+        };
+
+        static ThreadQueue& threadQueue()
+        {
+            static thread_local ThreadQueue queue{nullptr, 0};
+            return queue;
+        }
+
+        std::size_t sharedQueueIndex() const { return _queueCount - 1; }
+
+        std::size_t queueIndex() const
+        {
+            ThreadQueue& queue = threadQueue();
+            return queue.owner == this ? queue.index : sharedQueueIndex();
+        }
+
+        template <class F>
+        JobPtr makeJob(F task)
+        {
+            JobPtr job = _pool.acquire();
+            job->task = std::move(task);
+            return job;
+        }
+
+        /// Starts the worker threads, if they have not been started yet
+        void startThreads()
+        {
+            if(_threadCount == 0 || hasStartedThreads()) return;
+
+            std::lock_guard<std::mutex> lock(_workersMutex);
+            if(hasStartedThreads()) return;
+
+            _workers.reserve(_threadCount);
+            for(std::size_t i = 0; i < _threadCount; ++i)
+            {
+                _workers.emplace_back([this, i]() { workerLoop(i); });
+            }
+            _hasStartedThreads.store(true, std::memory_order_release);
+        }
+
+        template <class F, class TIterator>
+        JobHandle schedule(F task, TIterator firstDependency, TIterator lastDependency)
+        {
+            auto job = makeJob(std::move(task));
+            submit(job, firstDependency, lastDependency);
+            return JobHandle{job};
+        }
+
+        template <class TIterator>
+        void submit(const JobPtr& job, TIterator firstDependency, TIterator lastDependency)
+        {
+            startThreads();
+            _frameUnfinished.fetch_add(1, std::memory_order_relaxed);
+
+            for(; firstDependency != lastDependency; ++firstDependency)
+            {
+                const JobPtr& dependency = firstDependency->_job;
+                if(!dependency) continue;
+
+                std::lock_guard<std::mutex> lock(dependency->mutex);
+                if(!dependency->isFinished)
+                {
+                    job->waitingFor.fetch_add(1, std::memory_order_relaxed);
+                    dependency->dependents.push_back(job);
+                }
+            }
+
+            if(job->waitingFor.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                enqueue(job);
+            }
+        }
+
+        void enqueue(const JobPtr& job)
+        {
+            Queue& queue = _queues[queueIndex()];
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.jobs.push_back(job);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_sleepMutex);
+                ++_queuedCount;
+            }
+            _wakeCondition.notify_one();
+        }
+
+        /// Takes a job from this thread's queue, or steals one from another queue
+        JobPtr take()
+        {
+            if(_queuedCount.load(std::memory_order_acquire) == 0) return JobPtr();
+
+            std::size_t own = queueIndex();
+            JobPtr job;
+
+            {
+                Queue& queue = _queues[own];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if(!queue.jobs.empty())
+                {
+                    job = std::move(queue.jobs.back());
+                    queue.jobs.pop_back();
+                }
+            }
+
+            for(std::size_t i = 1; !job && i < _queueCount; ++i)
+            {
+                Queue& queue = _queues[(own + i) % _queueCount];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if(!queue.jobs.empty())
+                {
+                    job = std::move(queue.jobs.front());
+                    queue.jobs.pop_front();
+                }
+            }
+
+            if(job)
+            {
+                std::lock_guard<std::mutex> lock(_sleepMutex);
+                --_queuedCount;
+            }
+            return job;
+        }
+
+        /// Runs a single job, if one is available
+        /// \return true if a job was run
+        bool runOne()
+        {
+            JobPtr job = take();
+            if(!job) return false;
+
+            run(job);
+            return true;
+        }
+
+        void run(const JobPtr& job)
+        {
+            {
+                PINE_PROFILE_ZONE("Job");
+                try
+                {
+                    job->task();
+                }
+                catch(...)
+                {
+                    job->error = std::current_exception();
+                }
+            }
+
+            // the job may not be referred to by the task any more
+            job->task = nullptr;
+
+            finish(job);
+            _frameUnfinished.fetch_sub(1, std::memory_order_release);
+        }
+
+        void finish(const JobPtr& job)
+        {
+            if(job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+            std::vector<JobPtr> dependents;
+            {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->isFinished = true;
+                dependents.swap(job->dependents);
+            }
+
+            if(job->error)
+            {
+                std::lock_guard<std::mutex> lock(_frameErrorMutex);
+                if(!_frameError) _frameError = job->error;
+            }
+
+            for(auto& dependent : dependents)
+            {
+                if(dependent->waitingFor.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    enqueue(dependent);
+                }
+            }
+
+            if(job->parent)
+            {
+                JobPtr parent = std::move(job->parent);
+                if(job->error)
+                {
+                    std::lock_guard<std::mutex> lock(parent->mutex);
+                    if(!parent->error) parent->error = job->error;
+                }
+                finish(parent);
+            }
+        }
+
+        void workerLoop(std::size_t index)
+        {
+            PINE_PROFILE_THREAD("JobSystem worker");
+
+            threadQueue() = ThreadQueue{this, index};
+
+            for(;;)
+            {
+                if(runOne()) continue;
+
+                std::unique_lock<std::mutex> lock(_sleepMutex);
+                _wakeCondition.wait(lock, [this]() { return _isStopping || _queuedCount.load(std::memory_order_relaxed) > 0; });
+
+                if(_isStopping && _queuedCount.load(std::memory_order_relaxed) == 0) return;
+            }
+        }
+
+        /// The jobs, declared first so that it outlives the jobs referred to by the other members
+        detail::JobPool _pool;
+
+        /// The queue of each worker, followed by the queue shared by every other thread
+        std::unique_ptr<Queue[]> _queues;
+        std::size_t _queueCount;
+
+        /// The amount of jobs in the queues
+        std::atomic<std::size_t> _queuedCount;
+
+        /// The amount of jobs that have been scheduled, but not run
+        std::atomic<std::size_t> _frameUnfinished;
+
+        /// The first exception thrown by a job since the last waitForFrame()
+        std::exception_ptr _frameError;
+        std::mutex _frameErrorMutex;
+
+        /// The worker threads, started by the first job that is scheduled
+        std::vector<std::thread> _workers;
+        std::size_t _threadCount;
+        std::atomic<bool> _hasStartedThreads;
+        std::mutex _workersMutex;
+
+        std::mutex _sleepMutex;
+        std::condition_variable _wakeCondition;
+        bool _isStopping;
+    };
+}
+
+#endif // PINE_JOB_SYSTEM_HPP
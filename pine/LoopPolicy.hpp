@@ -0,0 +1,410 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_LOOP_POLICY_HPP
+#define PINE_LOOP_POLICY_HPP
+
+#include <ratio>
+
+#include <pine/Types.hpp>
+#include <pine/Time.hpp>
+#include <pine/GameLoad.hpp>
+
+/// \file
+/// Loop policies decide how the time that has passed in a frame is
+/// turned into updates of the game. A loop policy must provide:
+///
+/// - `template <class TGame> Real advance(TGame& game, Nanoseconds frameTime)`
+///     - updates the game for the time that has passed during a frame,
+///       and returns the interpolation factor for the frame
+/// - `Nanoseconds timeUntilNextTick() const`
+///     - the time from the start of the frame until the next update is due
+/// - `Tick getTickCount() const`
+///     - the amount of times the game has been updated
+///
+/// Policies that govern how many substeps are run in a frame (GovernedTimeStep)
+/// also require the game to provide `GameLoad& getLoad()`, which every Game does.
+///
+/// Time is kept in integer nanoseconds, and is only converted to
+/// seconds when the game is updated. Step sizes are given as template
+/// parameters, so that they are known at compile time.
+
+namespace pine
+{
+    /// The default amount of times a game is updated per second
+    const TicksPerSecond DEFAULT_TICK_RATE = 60;
+
+    namespace detail
+    {
+        template <class TRatio>
+        constexpr Nanoseconds ratio_to_nanoseconds()
+        {
+            return NANOSECONDS_PER_SECOND * TRatio::num / TRatio::den;
+        }
+    }
+
+    /// \brief Updates the game with a fixed delta time
+    ///
+    /// Time is accumulated each frame, and the game is updated for every
+    /// whole time step in the accumulator. The remainder is carried over
+    /// to the next frame, and is used as the interpolation factor.
+    ///
+    /// The accumulator is kept in units of 1 / (TickRate * 10^9) seconds, so
+    /// that steps are exact even when a step is not a whole amount of
+    /// nanoseconds; thus the game is updated at exactly the tick rate,
+    /// no matter how long it runs for.
+    ///
+    /// \tparam TickRate The amount of times the game is updated per second
+    /// \tparam MaxFrameTime The maximum time a frame may account for (as a std::ratio of seconds),
+    ///         time beyond this is dropped to prevent a spiral of death
+    template <TicksPerSecond TickRate = DEFAULT_TICK_RATE, class MaxFrameTime = std::ratio<1, 4> >
+    class FixedTimeStep
+    {
+        static_assert(TickRate > 0, "Tick rate must be positive");
+
+    public:
+
+        /// \return The delta time the game is updated with
+        static constexpr Seconds timeStep() { return Seconds(1) / TickRate; }
+
+        /// \return The maximum time a frame may account for
+        static constexpr Nanoseconds maxFrameTime() { return detail::ratio_to_nanoseconds<MaxFrameTime>(); }
+
+        FixedTimeStep() :
+            _accumulator(0),
+            _tickCount(0)
+        {
+        }
+
+        template <class TGame>
+        Real advance(TGame& game, Nanoseconds frameTime)
+        {
+            // cap the loop delta time
+            if(frameTime >= maxFrameTime())
+            {
+                frameTime = maxFrameTime();
+            }
+
+            _accumulator += frameTime * TickRate;
+
+            while(_accumulator >= NANOSECONDS_PER_SECOND)
+            {
+                game.update(timeStep()); // update the game (with the constant delta time)
+                _accumulator -= NANOSECONDS_PER_SECOND; // decrease the accumulator
+                ++_tickCount;
+            }
+
+            return static_cast<Real>(_accumulator) / NANOSECONDS_PER_SECOND;
+        }
+
+        Nanoseconds timeUntilNextTick() const
+        {
+            // round up, so that the step is due by then
+            return (NANOSECONDS_PER_SECOND - _accumulator + TickRate - 1) / TickRate;
+        }
+
+        Tick getTickCount() const { return _tickCount; }
+
+    private:
+
+        /// Used to accumulate time in the game loop, in units of 1 / (TickRate * 10^9) seconds
+        Nanoseconds _accumulator;
+
+        /// The amount of times the game has been updated
+        Tick _tickCount;
+    };
+
+    /// \brief What a GovernedTimeStep does with the steps beyond its maximum substeps
+    enum class OverloadPolicy
+    {
+        /// The steps are skipped; the game falls behind real time
+        Drop,
+
+        /// The steps are carried over to later frames (up to a maximum backlog),
+        /// so short spikes are caught up with; under sustained overload the
+        /// game runs slower than real time
+        Dilate,
+
+        /// The steps are merged into the substeps, which are updated with a larger
+        /// delta time; the game keeps up with real time, less accurately
+        Degrade
+    };
+
+    /// \brief Updates the game with a fixed delta time, running no more than a maximum amount of substeps a frame
+    ///
+    /// This behaves like FixedTimeStep until more steps are due in a frame than
+    /// the maximum substeps, in which case the overload policy decides what happens
+    /// to the remaining steps. Every frame is reported to the game's load
+    /// (see GameLoad), which states may query to shed optional work whilst the game
+    /// is under load.
+    ///
+    /// \tparam TickRate The amount of times the game is updated per second
+    /// \tparam MaxSubsteps The maximum amount of times the game is updated in a frame
+    /// \tparam Policy What happens to the steps beyond the maximum substeps
+    /// \tparam MaxBacklog The maximum time a frame may account for, and the maximum
+    ///         backlog of a Dilate policy (as a std::ratio of seconds)
+    template <TicksPerSecond TickRate = DEFAULT_TICK_RATE, unsigned MaxSubsteps = 4,
+              OverloadPolicy Policy = OverloadPolicy::Drop, class MaxBacklog = std::ratio<1, 4> >
+    class GovernedTimeStep
+    {
+        static_assert(TickRate > 0, "Tick rate must be positive");
+        static_assert(MaxSubsteps > 0, "There must be at least one step in a frame");
+
+    public:
+
+        /// \return The delta time of a single step
+        static constexpr Seconds timeStep() { return Seconds(1) / TickRate; }
+
+        /// \return The maximum amount of times the game is updated in a frame
+        static constexpr unsigned maxSubsteps() { return MaxSubsteps; }
+
+        /// \return The maximum time a frame may account for
+        static constexpr Nanoseconds maxBacklog() { return detail::ratio_to_nanoseconds<MaxBacklog>(); }
+
+        GovernedTimeStep() :
+            _accumulator(0),
+            _tickCount(0)
+        {
+        }
+
+        template <class TGame>
+        Real advance(TGame& game, Nanoseconds frameTime)
+        {
+            FrameLoad load;
+
+            if(frameTime > maxBacklog())
+            {
+                load.droppedSteps = (frameTime - maxBacklog()) * TickRate / NANOSECONDS_PER_SECOND;
+                load.isOverloaded = true;
+                frameTime = maxBacklog();
+            }
+
+            _accumulator += frameTime * TickRate;
+            load.dueSteps = static_cast<Tick>(_accumulator / NANOSECONDS_PER_SECOND);
+
+            if(load.dueSteps <= MaxSubsteps)
+            {
+                step(game, load, load.dueSteps, 1);
+            }
+            else
+            {
+                load.isOverloaded = true;
+
+                switch(Policy)
+                {
+                    case OverloadPolicy::Drop:
+                        load.droppedSteps += load.dueSteps - MaxSubsteps;
+                        _accumulator -= static_cast<Nanoseconds>(load.dueSteps - MaxSubsteps) * NANOSECONDS_PER_SECOND;
+                        step(game, load, MaxSubsteps, 1);
+                        break;
+                    case OverloadPolicy::Dilate:
+                    {
+                        step(game, load, MaxSubsteps, 1);
+
+                        // keep the backlog within its maximum
+                        Nanoseconds maxAccumulator = maxBacklog() * TickRate;
+                        if(_accumulator > maxAccumulator)
+                        {
+                            Nanoseconds dropped = (_accumulator - maxAccumulator) / NANOSECONDS_PER_SECOND;
+                            load.droppedSteps += dropped;
+                            _accumulator -= dropped * NANOSECONDS_PER_SECOND;
+                        }
+                        break;
+                    }
+                    case OverloadPolicy::Degrade:
+                    {
+                        // spread the due steps over the substeps, the first substeps take the extra steps
+                        Tick stepsPerSubstep = load.dueSteps / MaxSubsteps;
+                        Tick extraSteps = load.dueSteps % MaxSubsteps;
+                        step(game, load, extraSteps, stepsPerSubstep + 1);
+                        step(game, load, MaxSubsteps - extraSteps, stepsPerSubstep);
+                        load.mergedSteps = load.dueSteps - MaxSubsteps;
+                        break;
+                    }
+                }
+            }
+
+            Nanoseconds backlogSteps = _accumulator / NANOSECONDS_PER_SECOND;
+            load.backlog = backlogSteps * NANOSECONDS_PER_SECOND / TickRate;
+            game.getLoad().reportFrame(load);
+
+            return static_cast<Real>(_accumulator - backlogSteps * NANOSECONDS_PER_SECOND) / NANOSECONDS_PER_SECOND;
+        }
+
+        Nanoseconds timeUntilNextTick() const
+        {
+            // a backlog is run as soon as possible
+            if(_accumulator >= NANOSECONDS_PER_SECOND) return 0;
+
+            // round up, so that the step is due by then
+            return (NANOSECONDS_PER_SECOND - _accumulator + TickRate - 1) / TickRate;
+        }
+
+        Tick getTickCount() const { return _tickCount; }
+
+    private:
+
+        /// Updates the game a number of times, each covering a number of steps
+        template <class TGame>
+        void step(TGame& game, FrameLoad& load, Tick substeps, Tick stepsPerSubstep)
+        {
+            for(Tick i = 0; i < substeps; ++i)
+            {
+                game.update(timeStep() * stepsPerSubstep);
+                _accumulator -= static_cast<Nanoseconds>(stepsPerSubstep) * NANOSECONDS_PER_SECOND;
+                ++_tickCount;
+                ++load.substeps;
+            }
+        }
+
+        /// Used to accumulate time in the game loop, in units of 1 / (TickRate * 10^9) seconds
+        Nanoseconds _accumulator;
+
+        /// The amount of times the game has been updated
+        Tick _tickCount;
+    };
+
+    /// \brief Updates the game once a frame, with the time that has passed
+    ///
+    /// This has the least overhead per frame, but the game's behaviour
+    /// depends on the frame rate. The frame rate is determined entirely
+    /// by the frame pacer.
+    ///
+    /// \tparam MaxFrameTime The maximum delta time to update with (as a std::ratio of seconds)
+    template <class MaxFrameTime = std::ratio<1, 4> >
+    class VariableTimeStep
+    {
+    public:
+
+        /// \return The maximum delta time the game is updated with
+        static constexpr Nanoseconds maxFrameTime() { return detail::ratio_to_nanoseconds<MaxFrameTime>(); }
+
+        VariableTimeStep() : _tickCount(0) { }
+
+        template <class TGame>
+        Real advance(TGame& game, Nanoseconds frameTime)
+        {
+            game.update(to_seconds(frameTime < maxFrameTime() ? frameTime : maxFrameTime()));
+            ++_tickCount;
+            return 0;
+        }
+
+        Nanoseconds timeUntilNextTick() const { return 0; }
+
+        Tick getTickCount() const { return _tickCount; }
+
+    private:
+
+        Tick _tickCount;
+    };
+
+    /// \brief Updates the game with the time that has passed, split into steps no larger than a time step
+    ///
+    /// No time is carried over to the next frame, thus there is nothing to
+    /// interpolate; the last step of a frame is usually smaller than the rest.
+    /// Time beyond the maximum amount of steps is dropped.
+    ///
+    /// \tparam TickRate The amount of maximum sized steps per second
+    /// \tparam MaxSubsteps The maximum amount of steps in a frame
+    template <TicksPerSecond TickRate = DEFAULT_TICK_RATE, unsigned MaxSubsteps = 4>
+    class SemiFixedTimeStep
+    {
+        static_assert(TickRate > 0, "Tick rate must be positive");
+        static_assert(MaxSubsteps > 0, "There must be at least one step in a frame");
+
+    public:
+
+        /// \return The largest delta time the game is updated with
+        static constexpr Nanoseconds timeStep() { return NANOSECONDS_PER_SECOND / TickRate; }
+
+        /// \return The maximum amount of steps in a frame
+        static constexpr unsigned maxSubsteps() { return MaxSubsteps; }
+
+        SemiFixedTimeStep() : _tickCount(0) { }
+
+        template <class TGame>
+        Real advance(TGame& game, Nanoseconds frameTime)
+        {
+            for(unsigned step = 0; step < MaxSubsteps && frameTime > 0; ++step)
+            {
+                Nanoseconds deltaTime = frameTime < timeStep() ? frameTime : timeStep();
+                game.update(to_seconds(deltaTime));
+                frameTime -= deltaTime;
+                ++_tickCount;
+            }
+
+            return 0;
+        }
+
+        Nanoseconds timeUntilNextTick() const { return timeStep(); }
+
+        Tick getTickCount() const { return _tickCount; }
+
+    private:
+
+        Tick _tickCount;
+    };
+
+    /// \brief Updates the game exactly once a frame, with a fixed delta time
+    ///
+    /// The time that has passed is ignored; if the frame pacer cannot keep up,
+    /// the game runs slower rather than skipping steps. This keeps every
+    /// participant of a lockstep simulation in sync, given the same inputs.
+    ///
+    /// \tparam TickRate The amount of times the game is updated per second
+    template <TicksPerSecond TickRate = DEFAULT_TICK_RATE>
+    class LockstepTimeStep
+    {
+        static_assert(TickRate > 0, "Tick rate must be positive");
+
+    public:
+
+        /// \return The delta time the game is updated with
+        static constexpr Seconds timeStep() { return Seconds(1) / TickRate; }
+
+        LockstepTimeStep() : _tickCount(0) { }
+
+        template <class TGame>
+        Real advance(TGame& game, Nanoseconds frameTime)
+        {
+            game.update(timeStep());
+            ++_tickCount;
+            return 0;
+        }
+
+        Nanoseconds timeUntilNextTick() const { return NANOSECONDS_PER_SECOND / TickRate; }
+
+        Tick getTickCount() const { return _tickCount; }
+
+    private:
+
+        Tick _tickCount;
+    };
+}
+
+#endif // PINE_LOOP_POLICY_HPP
@@ -63,7 +63,7 @@ namespace pine
 
 #define PINE_VERSION_NUMBER PINE_VERSION_MAJOR.PINE_VERSION_MINOR.PINE_PATCH_NUMBER
 
-#include <pine/config.hpp>
+#include <pine/Config.hpp>
 #include <pine/Game.hpp>
 
 #endif // PINE_PINE_HPP
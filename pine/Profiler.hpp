@@ -0,0 +1,473 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_PROFILER_HPP
+#define PINE_PROFILER_HPP
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <ostream>
+#include <iomanip>
+#include <typeinfo>
+
+#ifdef __GNUG__
+#	include <cxxabi.h>
+#endif // __GNUG__
+
+#include <pine/Config.hpp>
+#include <pine/Time.hpp>
+
+/// \file
+/// A low overhead, hierarchical profiler for the game loop.
+///
+/// Zones are timed with scope guards, and recorded into a ring buffer
+/// owned by the thread that recorded them. The recorded zones may be
+/// exported as a Chrome trace (chrome://tracing, or https://ui.perfetto.dev).
+///
+/// The PINE_PROFILE_* macros are used to instrument code; they
+/// expand to nothing unless PINE_ENABLE_PROFILER is defined (see config.hpp).
+
+namespace pine
+{
+    /// \brief A zone recorded by the profiler
+    struct ProfileEvent
+    {
+        /// The name of the zone (must have static storage duration)
+        const char* name;
+
+        /// Extra information about the zone, e.g. the GameState type (may be null)
+        const char* detail;
+
+        /// The time the zone started
+        Nanoseconds start;
+
+        /// The time the zone took
+        Nanoseconds duration;
+
+        /// How many zones the zone is nested within
+        std::uint32_t depth;
+    };
+
+    /// \brief A ring buffer of the zones recorded by a single thread
+    ///
+    /// Only the owning thread records zones into the buffer, which it does
+    /// without a lock. When the buffer is full, the oldest zones are overwritten.
+    /// Each slot is versioned with the index of the zone written to it, so a zone
+    /// that is overwritten whilst it is being exported is skipped rather than torn.
+    /// Clearing the buffer only moves where exporting starts from, so the owning
+    /// thread never waits for (or reads anything written by) the profiler.
+    class ProfileBuffer
+    {
+    public:
+
+        ProfileBuffer(std::size_t capacity, std::uint32_t threadId) :
+            _slots(new Slot[capacity]),
+            _capacity(capacity),
+            _writeCount(0),
+            _clearCount(0),
+            _depth(0),
+            _threadId(threadId)
+        {
+        }
+
+        /// Records a zone, which must only be done by the owning thread
+        void push(const ProfileEvent& event)
+        {
+            std::uint64_t index = _writeCount.load(std::memory_order_relaxed);
+            Slot& slot = _slots[index % _capacity];
+
+            // the zone is released field by field, so a reader that sees any of it sees the slot being written
+            slot.version.store(Slot::WRITING, std::memory_order_relaxed);
+            slot.name.store(event.name, std::memory_order_release);
+            slot.detail.store(event.detail, std::memory_order_release);
+            slot.start.store(event.start, std::memory_order_release);
+            slot.duration.store(event.duration, std::memory_order_release);
+            slot.depth.store(event.depth, std::memory_order_release);
+            slot.version.store(index + 1, std::memory_order_release);
+
+            _writeCount.store(index + 1, std::memory_order_release);
+        }
+
+        /// Copies the zones in the buffer, oldest first
+        void copyTo(std::vector<ProfileEvent>& events) const
+        {
+            std::uint64_t writeCount = _writeCount.load(std::memory_order_acquire);
+            std::uint64_t first = writeCount > _capacity ? writeCount - _capacity : 0;
+            first = std::max(first, _clearCount.load(std::memory_order_relaxed));
+
+            for(std::uint64_t i = first; i < writeCount; ++i)
+            {
+                const Slot& slot = _slots[i % _capacity];
+                if(slot.version.load(std::memory_order_acquire) != i + 1) continue;
+
+                ProfileEvent event;
+                event.name = slot.name.load(std::memory_order_acquire);
+                event.detail = slot.detail.load(std::memory_order_acquire);
+                event.start = slot.start.load(std::memory_order_acquire);
+                event.duration = slot.duration.load(std::memory_order_acquire);
+                event.depth = slot.depth.load(std::memory_order_acquire);
+
+                // the zone was overwritten whilst it was copied
+                if(slot.version.load(std::memory_order_relaxed) != i + 1) continue;
+
+                events.push_back(event);
+            }
+        }
+
+        /// Discards the zones recorded so far, from the exported zones
+        void clear()
+        {
+            _clearCount.store(_writeCount.load(std::memory_order_acquire), std::memory_order_relaxed);
+        }
+
+        /// Empties the buffer for another thread to record into, which must only
+        /// be done once the thread that recorded into it has exited
+        /// \param capacity The amount of zones the buffer keeps
+        void reset(std::size_t capacity)
+        {
+            if(capacity != _capacity)
+            {
+                _slots.reset(new Slot[capacity]);
+                _capacity = capacity;
+            }
+            clear();
+            _depth = 0;
+            _threadName.clear();
+        }
+
+        std::uint32_t& depth() { return _depth; }
+
+        std::uint32_t getThreadId() const { return _threadId; }
+
+        /// \return The name of the thread, see Profiler::setThreadName
+        const std::string& getThreadName() const { return _threadName; }
+
+    private:
+
+        friend class Profiler;
+
+        // a zone, which may be read whilst the owning thread overwrites it
+        struct Slot
+        {
+            /// The version of a slot whilst it is being written
+            static const std::uint64_t WRITING = ~std::uint64_t(0);
+
+            Slot() : version(0) { }
+
+            /// The index of the zone in the slot plus one, 0 for an empty slot
+            std::atomic<std::uint64_t> version;
+            std::atomic<const char*> name;
+            std::atomic<const char*> detail;
+            std::atomic<Nanoseconds> start;
+            std::atomic<Nanoseconds> duration;
+            std::atomic<std::uint32_t> depth;
+        };
+
+        std::unique_ptr<Slot[]> _slots;
+        std::size_t _capacity;
+
+        /// The amount of zones recorded, only written by the owning thread
+        std::atomic<std::uint64_t> _writeCount;
+
+        /// The amount of zones recorded when the buffer was last cleared, which are not exported
+        std::atomic<std::uint64_t> _clearCount;
+
+        std::uint32_t _depth;
+        std::uint32_t _threadId;
+
+        /// The name of the thread, guarded by the profiler's lock
+        std::string _threadName;
+    };
+
+    /// \brief Owns the ring buffers of every thread that has been profiled
+    /// \author Miguel Martin
+    class Profiler
+    {
+    public:
+
+        /// The amount of zones each thread keeps, by default
+        static const std::size_t DEFAULT_BUFFER_CAPACITY = 1 << 16;
+
+        /// \return The profiler
+        static Profiler& instance()
+        {
+            static Profiler profiler;
+            return profiler;
+        }
+
+        /// \return The current time, in nanoseconds
+        static Nanoseconds now() { return time_now_ns(); }
+
+        /// \return The ring buffer of the calling thread, which is handed to
+        ///         another thread once the calling thread has exited
+        ProfileBuffer& getThreadBuffer()
+        {
+            static thread_local ThreadBuffer threadBuffer;
+            if(!threadBuffer.buffer)
+            {
+                threadBuffer.buffer = &acquireBuffer();
+            }
+            return *threadBuffer.buffer;
+        }
+
+        /// Names the calling thread in exported traces
+        /// \param name The name of the thread
+        void setThreadName(const std::string& name)
+        {
+            ProfileBuffer& buffer = getThreadBuffer();
+            std::lock_guard<std::mutex> lock(_mutex);
+            buffer._threadName = name;
+        }
+
+        /// Enables or disables recording of zones
+        void setEnabled(bool enabled) { _isEnabled.store(enabled, std::memory_order_relaxed); }
+
+        /// \return true if zones are being recorded
+        bool isEnabled() const { return _isEnabled.load(std::memory_order_relaxed); }
+
+        /// Sets the amount of zones kept by threads that have not been profiled yet
+        void setBufferCapacity(std::size_t capacity)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _bufferCapacity = capacity;
+        }
+
+        /// Clears the zones recorded by every thread
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for(auto& buffer : _buffers)
+            {
+                buffer->clear();
+            }
+        }
+
+        /// Writes the recorded zones of every thread in the Chrome trace event format
+        /// \param out The stream to write to
+        void writeChromeTrace(std::ostream& out)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::vector<ProfileEvent> events;
+            bool isFirst = true;
+
+            std::ios::fmtflags flags = out.flags();
+            std::streamsize precision = out.precision();
+            out << std::fixed << std::setprecision(3);
+
+            out << "{\"traceEvents\":[";
+            for(auto& buffer : _buffers)
+            {
+                const std::string& threadName = buffer->getThreadName();
+                if(!threadName.empty())
+                {
+                    out << (isFirst ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->getThreadId() << ",\"args\":{\"name\":";
+                    writeString(out, threadName);
+                    out << "}}";
+                    isFirst = false;
+                }
+
+                events.clear();
+                buffer->copyTo(events);
+                for(auto& event : events)
+                {
+                    out << (isFirst ? "" : ",") << "\n{\"name\":";
+                    writeString(out, event.name);
+                    out << ",\"cat\":\"pine\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->getThreadId()
+                        << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0;
+                    if(event.detail)
+                    {
+                        out << ",\"args\":{\"detail\":";
+                        writeString(out, demangle(event.detail));
+                        out << "}";
+                    }
+                    out << "}";
+                    isFirst = false;
+                }
+            }
+            out << "\n]}\n";
+
+            out.flags(flags);
+            out.precision(precision);
+        }
+
+    private:
+
+        // returns the buffer of a thread to the profiler once the thread exits
+        struct ThreadBuffer
+        {
+            ThreadBuffer() : buffer(nullptr) { }
+
+            ~ThreadBuffer()
+            {
+                if(buffer) Profiler::instance().releaseBuffer(*buffer);
+            }
+
+            ProfileBuffer* buffer;
+        };
+
+        Profiler() :
+            _isEnabled(true),
+            _bufferCapacity(DEFAULT_BUFFER_CAPACITY)
+        {
+        }
+
+        /// \return A buffer released by a thread that has exited, or a new buffer
+        ProfileBuffer& acquireBuffer()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(!_freeBuffers.empty())
+            {
+                ProfileBuffer* buffer = _freeBuffers.back();
+                _freeBuffers.pop_back();
+                buffer->reset(_bufferCapacity);
+                return *buffer;
+            }
+
+            _buffers.emplace_back(new ProfileBuffer(_bufferCapacity, static_cast<std::uint32_t>(_buffers.size())));
+            return *_buffers.back();
+        }
+
+        /// Releases the buffer of a thread that has exited, the zones it recorded
+        /// are kept (and exported) until another thread is handed the buffer
+        void releaseBuffer(ProfileBuffer& buffer)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _freeBuffers.push_back(&buffer);
+        }
+
+        static std::string demangle(const char* name)
+        {
+#ifdef __GNUG__
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+            if(status == 0 && demangled)
+            {
+                std::string result(demangled);
+                std::free(demangled);
+                return result;
+            }
+#endif // __GNUG__
+            return name;
+        }
+
+        static void writeString(std::ostream& out, const std::string& str)
+        {
+            out << '"';
+            for(char c : str)
+            {
+                if(c == '"' || c == '\\') out << '\\';
+                out << c;
+            }
+            out << '"';
+        }
+
+        std::mutex _mutex;
+        std::vector<std::unique_ptr<ProfileBuffer> > _buffers;
+
+        /// The buffers of the threads that have exited
+        std::vector<ProfileBuffer*> _freeBuffers;
+        std::atomic<bool> _isEnabled;
+        std::size_t _bufferCapacity;
+    };
+
+    /// \brief Times the scope it is declared in
+    class ProfileZone
+    {
+    public:
+
+        /// \param name The name of the zone (must have static storage duration)
+        /// \param detail Extra information about the zone (must have static storage duration, may be null)
+        explicit ProfileZone(const char* name, const char* detail = nullptr) :
+            _buffer(nullptr)
+        {
+            Profiler& profiler = Profiler::instance();
+            if(!profiler.isEnabled()) return;
+
+            _buffer = &profiler.getThreadBuffer();
+            _event.name = name;
+            _event.detail = detail;
+            _event.depth = _buffer->depth()++;
+            _event.start = Profiler::now();
+        }
+
+        ~ProfileZone()
+        {
+            if(!_buffer) return;
+
+            _event.duration = Profiler::now() - _event.start;
+            --_buffer->depth();
+            _buffer->push(_event);
+        }
+
+        ProfileZone(const ProfileZone&) = delete;
+        ProfileZone& operator=(const ProfileZone&) = delete;
+
+    private:
+
+        ProfileBuffer* _buffer;
+        ProfileEvent _event;
+    };
+
+    namespace detail
+    {
+        /// \return The name of the dynamic type of an object, for profiling
+        template <class T>
+        const char* profile_type_name(const T& object)
+        {
+#if defined(__GXX_RTTI) || defined(_CPPRTTI)
+            return typeid(object).name();
+#else
+            return nullptr;
+#endif
+        }
+    }
+}
+
+#define PINE_PROFILE_CONCAT_IMPL(a, b) a##b
+#define PINE_PROFILE_CONCAT(a, b) PINE_PROFILE_CONCAT_IMPL(a, b)
+
+#ifdef PINE_ENABLE_PROFILER
+/// Times the enclosing scope
+#	define PINE_PROFILE_ZONE(name) ::pine::ProfileZone PINE_PROFILE_CONCAT(pineProfileZone, __LINE__)(name)
+/// Times the enclosing scope, with the dynamic type of an object as detail
+#	define PINE_PROFILE_ZONE_TYPE(name, object) ::pine::ProfileZone PINE_PROFILE_CONCAT(pineProfileZone, __LINE__)(name, ::pine::detail::profile_type_name(object))
+/// Names the calling thread in exported traces
+#	define PINE_PROFILE_THREAD(name) ::pine::Profiler::instance().setThreadName(name)
+#else
+#	define PINE_PROFILE_ZONE(name)
+#	define PINE_PROFILE_ZONE_TYPE(name, object)
+#	define PINE_PROFILE_THREAD(name)
+#endif // PINE_ENABLE_PROFILER
+
+#endif // PINE_PROFILER_HPP
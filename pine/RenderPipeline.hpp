@@ -0,0 +1,279 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_RENDER_PIPELINE_HPP
+#define PINE_RENDER_PIPELINE_HPP
+
+#include <mutex>
+#include <array>
+#include <limits>
+#include <cstdint>
+#include <condition_variable>
+
+#include <cassert>
+
+#include <pine/Types.hpp>
+
+namespace pine
+{
+    /// \brief Statistics on a RenderPipeline
+    struct RenderPipelineStats
+    {
+        RenderPipelineStats() :
+            producedCount(0),
+            consumedCount(0),
+            droppedCount(0)
+        {
+        }
+
+        /// The amount of frames the simulation has produced
+        std::uint64_t producedCount;
+
+        /// The amount of frames that have been rendered
+        std::uint64_t consumedCount;
+
+        /// The amount of frames that were replaced by a newer frame before they were rendered
+        std::uint64_t droppedCount;
+    };
+
+    /// \brief Hands frames from the simulation thread to the render thread
+    ///
+    /// The pipeline has a fixed amount of buffers (slots). The simulation thread
+    /// writes a snapshot of the frame it has just simulated into a free slot
+    /// (see GameState::produceSnapshot), whilst the render thread renders the
+    /// snapshot in another slot (see GameState::consumeSnapshot).
+    ///
+    /// - With two buffers, the simulation waits for the render thread when it is
+    ///   a frame ahead.
+    /// - With three buffers, the simulation never waits: a frame that has not
+    ///   been rendered by the time a newer frame is ready is dropped.
+    ///
+    /// \author Miguel Martin
+    class RenderPipeline
+    {
+    public:
+
+        /// The maximum amount of buffers in a pipeline
+        static constexpr std::size_t maxBufferCount() { return 3; }
+
+        /// \param bufferCount The amount of buffers, 2 or 3
+        explicit RenderPipeline(std::size_t bufferCount = maxBufferCount()) :
+            _bufferCount(bufferCount),
+            _frameCount(0),
+            _isStopped(false)
+        {
+            assert(bufferCount >= 2 && bufferCount <= maxBufferCount() && "A RenderPipeline is double or triple buffered");
+        }
+
+        RenderPipeline(const RenderPipeline&) = delete;
+        RenderPipeline& operator=(const RenderPipeline&) = delete;
+
+        /// Starts writing a frame, waiting for a free slot if necessary
+        /// \param slot Set to the slot to write the frame into
+        /// \return false if the pipeline has been stopped
+        bool beginProduce(std::size_t& slot)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [&]() { return _isStopped || findSlot(Slot::State::Free, slot); });
+            if(_isStopped) return false;
+
+            _slots[slot].state = Slot::State::Writing;
+            _slots[slot].frame = ++_frameCount;
+            return true;
+        }
+
+        /// Hands a written frame to the render thread
+        /// \param slot The slot that was written
+        /// \param interpolation How far the frame is between the previous and next update
+        void endProduce(std::size_t slot, Real interpolation)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                assert(_slots[slot].state == Slot::State::Writing);
+
+                std::size_t ready;
+                if(findSlot(Slot::State::Ready, ready))
+                {
+                    _slots[ready].state = Slot::State::Free;
+                    ++_stats.droppedCount;
+                }
+
+                _slots[slot].state = Slot::State::Ready;
+                _slots[slot].interpolation = interpolation;
+                ++_stats.producedCount;
+            }
+            _condition.notify_all();
+        }
+
+        /// Starts rendering the most recent frame, waiting for one if necessary
+        /// \param slot Set to the slot to render
+        /// \param interpolation Set to how far the frame is between the previous and next update
+        /// \return false if the pipeline has been stopped
+        bool beginConsume(std::size_t& slot, Real& interpolation)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [&]() { return _isStopped || findSlot(Slot::State::Ready, slot); });
+            if(_isStopped) return false;
+
+            _slots[slot].state = Slot::State::Consuming;
+            interpolation = _slots[slot].interpolation;
+            return true;
+        }
+
+        /// Finishes rendering a frame, freeing its slot
+        /// \param slot The slot that was rendered
+        void endConsume(std::size_t slot)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                assert(_slots[slot].state == Slot::State::Consuming);
+
+                _slots[slot].state = Slot::State::Free;
+                ++_stats.consumedCount;
+            }
+            _condition.notify_all();
+        }
+
+        /// Stops the pipeline, waking both threads
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _isStopped = true;
+            }
+            _condition.notify_all();
+        }
+
+        bool isStopped() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _isStopped;
+        }
+
+        /// \return The number of the most recent frame that has started being written,
+        ///         frames are numbered from 1
+        std::uint64_t getLastFrame() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _frameCount;
+        }
+
+        /// \return The number of the oldest frame that may still be rendered,
+        ///         or the largest number possible if there is none
+        std::uint64_t getOldestFrameInFlight() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+            for(std::size_t i = 0; i < _bufferCount; ++i)
+            {
+                if(_slots[i].state != Slot::State::Free && _slots[i].frame < oldest)
+                {
+                    oldest = _slots[i].frame;
+                }
+            }
+            return oldest;
+        }
+
+        std::size_t getBufferCount() const { return _bufferCount; }
+
+        RenderPipelineStats getStats() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _stats;
+        }
+
+    private:
+
+        struct Slot
+        {
+            enum class State
+            {
+                Free,
+                Writing,
+                Ready,
+                Consuming
+            };
+
+            Slot() :
+                state(State::Free),
+                frame(0),
+                interpolation(0)
+            {
+            }
+
+            State state;
+            std::uint64_t frame;
+            Real interpolation;
+        };
+
+        bool findSlot(typename Slot::State state, std::size_t& slot) const
+        {
+            for(std::size_t i = 0; i < _bufferCount; ++i)
+            {
+                if(_slots[i].state == state)
+                {
+                    slot = i;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::array<Slot, 3> _slots;
+        std::size_t _bufferCount;
+        std::uint64_t _frameCount;
+        RenderPipelineStats _stats;
+        bool _isStopped;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _condition;
+    };
+
+    /// \brief Storage for a GameState's render snapshots, one per slot of a RenderPipeline
+    /// \tparam T The data a GameState needs to render a frame
+    ///
+    /// \code
+    /// void produceSnapshot(std::size_t slot) override { _snapshots[slot].position = _position; }
+    /// void consumeSnapshot(std::size_t slot, pine::Real interpolation) override { draw(_snapshots[slot].position); }
+    /// \endcode
+    template <class T>
+    class SnapshotBuffer
+    {
+    public:
+
+        T& operator[](std::size_t slot) { return _snapshots[slot]; }
+        const T& operator[](std::size_t slot) const { return _snapshots[slot]; }
+
+    private:
+
+        std::array<T, RenderPipeline::maxBufferCount()> _snapshots;
+    };
+}
+
+#endif // PINE_RENDER_PIPELINE_HPP
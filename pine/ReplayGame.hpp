@@ -0,0 +1,150 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+
+#ifndef PINE_REPLAYGAME_HPP
+#define PINE_REPLAYGAME_HPP
+
+#include <string>
+#include <stdexcept>
+
+#include <pine/RunGame.hpp>
+#include <pine/TickLog.hpp>
+
+namespace pine
+{
+    namespace detail
+    {
+        /// Replays a recorded game, as fast as it can be updated
+        ///
+        /// Each recorded frame is replayed: the game's frame is started, it is
+        /// updated with each recorded delta time, and the frame is ended with the
+        /// recorded interpolation. No time is waited between frames.
+        ///
+        /// \param game The game you wish to replay, which must be initialized
+        /// \param log The log to replay, see TickLog::replay
+        /// \return The error code generated by the game
+        template <class TGame>
+        int ReplayGame(TGame& game, TickLog& log)
+        {
+            static_assert(std::is_base_of<GameType, TGame>::value, "Game is not a GameType");
+
+            game.setTickLog(&log);
+
+            bool isInFrame = false;
+            TickLogStep step;
+            while(game.isRunning() && log.readStep(step))
+            {
+                if(!isInFrame)
+                {
+                    game.frameStart();
+                    isInFrame = true;
+                }
+
+                if(step.type == TickLogStep::Type::Tick)
+                {
+                    game.update(step.deltaTime);
+                }
+                else
+                {
+                    game.frameEnd(step.interpolation);
+                    isInFrame = false;
+                }
+            }
+
+            game.setTickLog(nullptr);
+
+            // the recording ended before the game quit
+            if(game.isRunning()) game.quit(0);
+
+            return game.getErrorState();
+        }
+    }
+
+    /// Runs a game, recording its ticks to a file (see TickLog)
+    /// \tparam TLoopPolicy Decides how the game is updated each frame, see LoopPolicy.hpp
+    /// \param path The file to record to
+    /// \param pacer The frame pacer used to wait between frames, this determines the frame rate
+    /// \param clock The clock used to time the game loop, see Clock.hpp
+    template <class TGame, class TLoopPolicy = FixedTimeStep<>, class TFramePacer, class TClock>
+    int RecordGame(int argc, char* argv[], const std::string& path, TFramePacer& pacer, TClock& clock)
+    {
+        TickLog log;
+        if(!log.record(path))
+        {
+            throw std::runtime_error("Could not create the tick log: " + path);
+        }
+
+        return detail::GameRunner<TGame, typename TGame::Engine>().run(argc, argv, [&](TGame& game)
+        {
+            game.setTickLog(&log);
+            int errorState = detail::RunGame<TLoopPolicy>(game, pacer, clock);
+            game.setTickLog(nullptr);
+            return errorState;
+        });
+    }
+
+    /// Runs a game, recording its ticks to a file (see TickLog)
+    /// \tparam TLoopPolicy Decides how the game is updated each frame, see LoopPolicy.hpp
+    /// \param path The file to record to
+    template <class TGame, class TLoopPolicy = FixedTimeStep<> >
+    int RecordGame(int argc, char* argv[], const std::string& path)
+    {
+        SystemClock clock;
+        HybridFramePacer pacer;
+        return RecordGame<TGame, TLoopPolicy>(argc, argv, path, pacer, clock);
+    }
+
+    /// Replays a game recorded with RecordGame, as fast as it can be updated
+    /// \param path The file to replay
+    /// \param log Set to the replayed log, e.g. to check whether the replay diverged
+    template <class TGame>
+    int ReplayGame(int argc, char* argv[], const std::string& path, TickLog& log)
+    {
+        if(!log.replay(path))
+        {
+            throw std::runtime_error("Could not open the tick log: " + path);
+        }
+
+        return detail::GameRunner<TGame, typename TGame::Engine>().run(argc, argv, [&](TGame& game)
+        {
+            return detail::ReplayGame(game, log);
+        });
+    }
+
+    /// Replays a game recorded with RecordGame, as fast as it can be updated
+    /// \param path The file to replay
+    template <class TGame>
+    int ReplayGame(int argc, char* argv[], const std::string& path)
+    {
+        TickLog log;
+        return ReplayGame<TGame>(argc, argv, path, log);
+    }
+}
+
+#endif // PINE_REPLAYGAME_HPP
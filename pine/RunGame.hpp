@@ -26,88 +26,132 @@
 
 #include <type_traits>
 
-#include <pine/time.hpp>
-#include <pine/types.hpp>
+#include <pine/Time.hpp>
+#include <pine/Types.hpp>
 #include <pine/Game.hpp>
+#include <pine/Clock.hpp>
+#include <pine/FramePacer.hpp>
+#include <pine/LoopPolicy.hpp>
+#include <pine/Profiler.hpp>
 
 namespace pine
 {
     namespace detail
     {
         /// Runs the game
+        ///
+        /// How the game is updated each frame is decided by the loop policy.
+        /// The rate that frames are rendered at is determined by the frame pacer,
+        /// each frame is given how far the game is between its previous and next
+        /// update, so that it may interpolate.
+        ///
+        /// \tparam TLoopPolicy The loop policy, see LoopPolicy.hpp
         /// \param game The game you wish to run
+        /// \param pacer The frame pacer used to wait between frames
+        /// \param clock The clock used to time the game loop, see Clock.hpp
         /// \return The error code generated by the game
-        template <class TGame>
-        int RunGame(TGame& game)
+        template <class TLoopPolicy, class TGame, class TFramePacer, class TClock>
+        int RunGame(TGame& game, TFramePacer& pacer, TClock& clock)
         {
             static_assert(std::is_base_of<GameType, TGame>::value, "Game is not a GameType");
 
-            const float MAX_FRAME_TIME = 1 / 4.f;
-            const float DELTA_TIME = 1 / 60.f;
-            Seconds currentTime = 0; // Holds the current time
-            Seconds accumulator = 0; // Used to accumulate time in the game loop
+            TLoopPolicy loop;
+            Nanoseconds currentTime = clock.now(); // Holds the current time
 
             while(game.isRunning())
             {
+                PINE_PROFILE_ZONE("RunGame::frame");
+
                 game.frameStart();
 
-                Seconds newTime = pine::time_now();
-                Seconds frameTime = newTime - currentTime;
+                Nanoseconds newTime = clock.now();
+                Nanoseconds frameTime = newTime - currentTime;
                 currentTime = newTime;
 
-                // cap the loop delta time
-                if(frameTime >= MAX_FRAME_TIME)
-                {
-                    frameTime = MAX_FRAME_TIME;
-                }
-
-                accumulator += frameTime;
-
                 // Update our game
-                while(accumulator >= DELTA_TIME)
+                Real interpolation;
                 {
-                    game.update(DELTA_TIME); // update the game (with the constant delta time)
-                    accumulator -= DELTA_TIME; // decrease the accumulator
+                    PINE_PROFILE_ZONE("RunGame::advance");
+                    interpolation = loop.advance(game, frameTime);
                 }
 
-                game.frameEnd();
+                game.frameEnd(interpolation);
+
+                // wait until the next frame is due
+                PINE_PROFILE_ZONE("RunGame::pace");
+                pacer.pace(clock, newTime, currentTime + loop.timeUntilNextTick());
             }
 
             return game.getErrorState();
         }
 
+        /// Constructs and initializes a game (and its engine), then runs it
         template <class TGame, class TEngine>
         struct GameRunner
         {
-            int operator()(int argc, char* argv[])
+            /// \param loop Runs the game loop, given the game
+            template <class TLoop>
+            int run(int argc, char* argv[], TLoop loop)
             {
                 TEngine engine;
                 TGame game;
                 game.setEngine(engine);
                 game.init(argc, argv);
 
-                return detail::RunGame(game);
+                int errorState = loop(game);
+
+                // the jobs may refer to the game, so they must finish before it is destroyed
+                engine.releaseJobSystem();
+                return errorState;
             }
         };
 
         template <class TGame>
         struct GameRunner<TGame, void>
         {
-            int operator()(int argc, char* argv[])
+            /// \param loop Runs the game loop, given the game
+            template <class TLoop>
+            int run(int argc, char* argv[], TLoop loop)
             {
                 TGame game;
                 game.init(argc, argv);
 
-                return detail::RunGame(game);
+                return loop(game);
             }
         };
     }
 
-    // game with engine
-    template <class TGame>
+    /// Runs a game, with a frame pacer and a clock
+    /// \tparam TLoopPolicy Decides how the game is updated each frame, see LoopPolicy.hpp
+    /// \param pacer The frame pacer used to wait between frames, this determines the frame rate
+    /// \param clock The clock used to time the game loop, see Clock.hpp
+    template <class TGame, class TLoopPolicy = FixedTimeStep<>, class TFramePacer, class TClock>
+    int RunGame(int argc, char* argv[], TFramePacer& pacer, TClock& clock)
+    {
+        return detail::GameRunner<TGame, typename TGame::Engine>().run(argc, argv, [&](TGame& game)
+        {
+            return detail::RunGame<TLoopPolicy>(game, pacer, clock);
+        });
+    }
+
+    /// Runs a game, with a frame pacer
+    /// \tparam TLoopPolicy Decides how the game is updated each frame, see LoopPolicy.hpp
+    /// \param pacer The frame pacer used to wait between frames, this determines the frame rate
+    /// \see FramePacer.hpp for the available frame pacers
+    template <class TGame, class TLoopPolicy = FixedTimeStep<>, class TFramePacer>
+    int RunGame(int argc, char* argv[], TFramePacer& pacer)
+    {
+        SystemClock clock;
+        return RunGame<TGame, TLoopPolicy>(argc, argv, pacer, clock);
+    }
+
+    /// Runs a game, sleeping between frames until the next update is due
+    /// \tparam TLoopPolicy Decides how the game is updated each frame, see LoopPolicy.hpp
+    template <class TGame, class TLoopPolicy = FixedTimeStep<> >
     int RunGame(int argc, char* argv[])
     {
-        return detail::GameRunner<TGame, typename TGame::Engine>()(argc, argv);
+        HybridFramePacer pacer;
+        return RunGame<TGame, TLoopPolicy>(argc, argv, pacer);
     }
 }
 
@@ -0,0 +1,189 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_RUN_PIPELINED_GAME_HPP
+#define PINE_RUN_PIPELINED_GAME_HPP
+
+#include <thread>
+#include <exception>
+#include <type_traits>
+
+#include <pine/Time.hpp>
+#include <pine/Types.hpp>
+#include <pine/Game.hpp>
+#include <pine/Clock.hpp>
+#include <pine/FramePacer.hpp>
+#include <pine/LoopPolicy.hpp>
+#include <pine/RenderPipeline.hpp>
+#include <pine/RunGame.hpp>
+#include <pine/Profiler.hpp>
+
+namespace pine
+{
+    namespace detail
+    {
+        /// Runs the game, rendering each frame on a render thread whilst the next frame is simulated
+        ///
+        /// The game loop is the same as RunGame's, except that at the end of each frame the
+        /// game produces a snapshot of the frame (see StatedGame::setRenderPipeline), which
+        /// is rendered on the render thread with TGame::renderFrame.
+        ///
+        /// \tparam TLoopPolicy The loop policy, see LoopPolicy.hpp
+        /// \param game The game you wish to run
+        /// \param pacer The frame pacer used to wait between frames
+        /// \param clock The clock used to time the game loop, see Clock.hpp
+        /// \param bufferCount The amount of snapshots buffered between the threads, 2 or 3
+        /// \return The error code generated by the game
+        template <class TLoopPolicy, class TGame, class TFramePacer, class TClock>
+        int RunPipelinedGame(TGame& game, TFramePacer& pacer, TClock& clock, std::size_t bufferCount)
+        {
+            static_assert(std::is_base_of<GameType, TGame>::value, "Game is not a GameType");
+
+            RenderPipeline pipeline(bufferCount);
+            std::exception_ptr renderError;
+
+            game.setRenderPipeline(&pipeline);
+
+            std::thread renderer([&]()
+            {
+                PINE_PROFILE_THREAD("Render");
+
+                std::size_t slot = 0;
+                Real interpolation = 0;
+                while(pipeline.beginConsume(slot, interpolation))
+                {
+                    try
+                    {
+                        PINE_PROFILE_ZONE("RunPipelinedGame::render");
+                        game.renderFrame(slot, interpolation);
+                    }
+                    catch(...)
+                    {
+                        renderError = std::current_exception();
+                        pipeline.endConsume(slot);
+                        pipeline.stop();
+                        return;
+                    }
+                    pipeline.endConsume(slot);
+                }
+            });
+
+            auto stopRendering = [&]()
+            {
+                pipeline.stop();
+                renderer.join();
+                game.setRenderPipeline(nullptr);
+            };
+
+            try
+            {
+                TLoopPolicy loop;
+                Nanoseconds currentTime = clock.now(); // Holds the current time
+
+                // stops if the render thread has failed
+                while(game.isRunning() && !pipeline.isStopped())
+                {
+                    PINE_PROFILE_ZONE("RunPipelinedGame::frame");
+
+                    game.frameStart();
+
+                    Nanoseconds newTime = clock.now();
+                    Nanoseconds frameTime = newTime - currentTime;
+                    currentTime = newTime;
+
+                    // Update our game
+                    Real interpolation;
+                    {
+                        PINE_PROFILE_ZONE("RunPipelinedGame::advance");
+                        interpolation = loop.advance(game, frameTime);
+                    }
+
+                    // hands the frame to the render thread
+                    game.frameEnd(interpolation);
+
+                    // wait until the next frame is due
+                    PINE_PROFILE_ZONE("RunPipelinedGame::pace");
+                    pacer.pace(clock, newTime, currentTime + loop.timeUntilNextTick());
+                }
+            }
+            catch(...)
+            {
+                stopRendering();
+                throw;
+            }
+
+            stopRendering();
+
+            if(renderError) std::rethrow_exception(renderError);
+
+            return game.getErrorState();
+        }
+    }
+
+    /// Runs a game, rendering on a dedicated thread, with a frame pacer and a clock
+    ///
+    /// Frame N is rendered on the render thread whilst frame N + 1 is simulated, so
+    /// a frame takes about as long as the longer of its update and its render, rather
+    /// than both. The game must be a StatedGame that defines onRenderFrame(Real interpolation),
+    /// which is called on the render thread after its states have consumed their snapshots
+    /// (see GameState::produceSnapshot and GameState::consumeSnapshot).
+    ///
+    /// \tparam TLoopPolicy Decides how the game is updated each frame, see LoopPolicy.hpp
+    /// \param pacer The frame pacer used to wait between frames, this paces the simulation
+    /// \param clock The clock used to time the game loop, see Clock.hpp
+    /// \param bufferCount The amount of snapshots buffered between the threads, 2 or 3 (see RenderPipeline)
+    template <class TGame, class TLoopPolicy = FixedTimeStep<>, class TFramePacer, class TClock>
+    int RunPipelinedGame(int argc, char* argv[], TFramePacer& pacer, TClock& clock, std::size_t bufferCount = RenderPipeline::maxBufferCount())
+    {
+        return detail::GameRunner<TGame, typename TGame::Engine>().run(argc, argv, [&](TGame& game)
+        {
+            return detail::RunPipelinedGame<TLoopPolicy>(game, pacer, clock, bufferCount);
+        });
+    }
+
+    /// Runs a game, rendering on a dedicated thread, with a frame pacer
+    /// \tparam TLoopPolicy Decides how the game is updated each frame, see LoopPolicy.hpp
+    /// \param pacer The frame pacer used to wait between frames, this paces the simulation
+    template <class TGame, class TLoopPolicy = FixedTimeStep<>, class TFramePacer>
+    int RunPipelinedGame(int argc, char* argv[], TFramePacer& pacer)
+    {
+        SystemClock clock;
+        return RunPipelinedGame<TGame, TLoopPolicy>(argc, argv, pacer, clock);
+    }
+
+    /// Runs a game, rendering on a dedicated thread
+    /// \tparam TLoopPolicy Decides how the game is updated each frame, see LoopPolicy.hpp
+    template <class TGame, class TLoopPolicy = FixedTimeStep<> >
+    int RunPipelinedGame(int argc, char* argv[])
+    {
+        HybridFramePacer pacer;
+        return RunPipelinedGame<TGame, TLoopPolicy>(argc, argv, pacer);
+    }
+}
+
+#endif // PINE_RUN_PIPELINED_GAME_HPP
@@ -0,0 +1,412 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_STATE_ALLOCATOR_HPP
+#define PINE_STATE_ALLOCATOR_HPP
+
+#include <new>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include <cassert>
+
+namespace pine
+{
+    /// \brief Statistics on the memory a StateAllocator has handed out
+    struct StateAllocatorStats
+    {
+        StateAllocatorStats() :
+            allocationCount(0),
+            deallocationCount(0),
+            liveCount(0),
+            peakLiveCount(0),
+            bytesInUse(0),
+            peakBytesInUse(0),
+            heapFallbackCount(0)
+        {
+        }
+
+        /// The total amount of allocations
+        std::size_t allocationCount;
+
+        /// The total amount of deallocations
+        std::size_t deallocationCount;
+
+        /// The amount of allocations that have not been deallocated
+        std::size_t liveCount;
+
+        /// The most allocations that were alive at once
+        std::size_t peakLiveCount;
+
+        /// The amount of bytes that are allocated
+        std::size_t bytesInUse;
+
+        /// The most bytes that were allocated at once
+        std::size_t peakBytesInUse;
+
+        /// The amount of allocations that could not be served by the
+        /// allocator, and had to be allocated from the heap instead
+        std::size_t heapFallbackCount;
+    };
+
+    /// \brief Allocates the memory for GameStates
+    ///
+    /// A GameStateStack may be given an allocator, which is used to allocate
+    /// the GameStates that the stack constructs itself (i.e. with push<TGameState>()).
+    /// Allocators are only used from the thread running the game loop.
+    ///
+    /// \author Miguel Martin
+    class StateAllocator
+    {
+    public:
+
+        virtual ~StateAllocator() {}
+
+        /// Allocates memory for a GameState
+        /// \param size The size of the GameState
+        /// \param alignment The alignment of the GameState
+        /// \return The allocated memory (never null)
+        void* allocate(std::size_t size, std::size_t alignment)
+        {
+            assert(alignment <= alignof(std::max_align_t) && "Over-aligned GameStates are not supported");
+
+            void* memory = doAllocate(size, alignment);
+
+            ++_stats.allocationCount;
+            ++_stats.liveCount;
+            _stats.bytesInUse += size;
+            if(_stats.liveCount > _stats.peakLiveCount) _stats.peakLiveCount = _stats.liveCount;
+            if(_stats.bytesInUse > _stats.peakBytesInUse) _stats.peakBytesInUse = _stats.bytesInUse;
+
+            return memory;
+        }
+
+        /// Deallocates memory for a GameState
+        /// \param memory The memory, which was returned by allocate()
+        /// \param size The size the memory was allocated with
+        /// \param alignment The alignment the memory was allocated with
+        void deallocate(void* memory, std::size_t size, std::size_t alignment)
+        {
+            doDeallocate(memory, size, alignment);
+
+            ++_stats.deallocationCount;
+            --_stats.liveCount;
+            _stats.bytesInUse -= size;
+        }
+
+        /// \return Statistics on the memory the allocator has handed out
+        const StateAllocatorStats& getStats() const { return _stats; }
+
+    protected:
+
+        /// Called when an allocation could not be served, and was allocated from the heap
+        void onHeapFallback() { ++_stats.heapFallbackCount; }
+
+    private:
+
+        virtual void* doAllocate(std::size_t size, std::size_t alignment) = 0;
+        virtual void doDeallocate(void* memory, std::size_t size, std::size_t alignment) = 0;
+
+        StateAllocatorStats _stats;
+    };
+
+    /// \brief Allocates GameStates on the heap
+    ///
+    /// This is what a GameStateStack does when it has no allocator,
+    /// however this allocator also keeps statistics.
+    class HeapStateAllocator : public StateAllocator
+    {
+    private:
+
+        virtual void* doAllocate(std::size_t size, std::size_t alignment) override
+        {
+            return ::operator new(size);
+        }
+
+        virtual void doDeallocate(void* memory, std::size_t size, std::size_t alignment) override
+        {
+            ::operator delete(memory);
+        }
+    };
+
+    /// \brief Allocates GameStates from free-lists, one for each size of GameState
+    ///
+    /// Memory is taken from the heap in chunks of blocks, and blocks are
+    /// returned to their free-list when a GameState is destroyed. Thus
+    /// once a type of GameState has been pushed, pushing it again does
+    /// not allocate. Memory is only returned to the heap when the
+    /// allocator is destroyed.
+    class PoolStateAllocator : public StateAllocator
+    {
+    public:
+
+        /// \brief Statistics on a single pool
+        struct PoolStats
+        {
+            /// The size of each block in the pool
+            std::size_t blockSize;
+
+            /// The amount of blocks the pool owns
+            std::size_t blockCount;
+
+            /// The amount of blocks that are free
+            std::size_t freeCount;
+        };
+
+        /// \param blocksPerChunk The amount of blocks taken from the heap at once
+        explicit PoolStateAllocator(std::size_t blocksPerChunk = 8) :
+            _blocksPerChunk(blocksPerChunk)
+        {
+            assert(blocksPerChunk > 0);
+        }
+
+        PoolStateAllocator(const PoolStateAllocator&) = delete;
+        PoolStateAllocator& operator=(const PoolStateAllocator&) = delete;
+
+        /// Reserves blocks for a GameState type up front, so that
+        /// the first push of it does not allocate
+        /// \param count The amount of blocks to reserve
+        template <class TGameState>
+        void reserve(std::size_t count)
+        {
+            Pool& pool = getPool(blockSize(sizeof(TGameState), alignof(TGameState)));
+            while(pool.stats.freeCount < count)
+            {
+                grow(pool);
+            }
+        }
+
+        /// \return Statistics on each pool
+        std::vector<PoolStats> getPoolStats() const
+        {
+            std::vector<PoolStats> stats;
+            for(auto& pool : _pools)
+            {
+                stats.push_back(pool.stats);
+            }
+            return stats;
+        }
+
+    private:
+
+        struct FreeBlock
+        {
+            FreeBlock* next;
+        };
+
+        struct Pool
+        {
+            PoolStats stats;
+            FreeBlock* freeList;
+            std::vector<std::unique_ptr<unsigned char[]> > chunks;
+        };
+
+        static std::size_t blockSize(std::size_t size, std::size_t alignment)
+        {
+            std::size_t alignTo = alignment > alignof(FreeBlock) ? alignment : alignof(FreeBlock);
+            std::size_t blockSize = size > sizeof(FreeBlock) ? size : sizeof(FreeBlock);
+            return (blockSize + alignTo - 1) / alignTo * alignTo;
+        }
+
+        Pool& getPool(std::size_t blockSize)
+        {
+            for(auto& pool : _pools)
+            {
+                if(pool.stats.blockSize == blockSize) return pool;
+            }
+
+            _pools.emplace_back();
+            Pool& pool = _pools.back();
+            pool.stats.blockSize = blockSize;
+            pool.stats.blockCount = 0;
+            pool.stats.freeCount = 0;
+            pool.freeList = nullptr;
+            return pool;
+        }
+
+        void grow(Pool& pool)
+        {
+            // new[] of unsigned char is aligned suitably for any fundamental type
+            pool.chunks.emplace_back(new unsigned char[pool.stats.blockSize * _blocksPerChunk]);
+            unsigned char* chunk = pool.chunks.back().get();
+
+            for(std::size_t i = _blocksPerChunk; i-- > 0;)
+            {
+                FreeBlock* block = reinterpret_cast<FreeBlock*>(chunk + i * pool.stats.blockSize);
+                block->next = pool.freeList;
+                pool.freeList = block;
+            }
+
+            pool.stats.blockCount += _blocksPerChunk;
+            pool.stats.freeCount += _blocksPerChunk;
+        }
+
+        virtual void* doAllocate(std::size_t size, std::size_t alignment) override
+        {
+            Pool& pool = getPool(blockSize(size, alignment));
+            if(!pool.freeList)
+            {
+                grow(pool);
+            }
+
+            FreeBlock* block = pool.freeList;
+            pool.freeList = block->next;
+            --pool.stats.freeCount;
+            return block;
+        }
+
+        virtual void doDeallocate(void* memory, std::size_t size, std::size_t alignment) override
+        {
+            Pool& pool = getPool(blockSize(size, alignment));
+
+            FreeBlock* block = static_cast<FreeBlock*>(memory);
+            block->next = pool.freeList;
+            pool.freeList = block;
+            ++pool.stats.freeCount;
+        }
+
+        std::size_t _blocksPerChunk;
+        std::vector<Pool> _pools;
+    };
+
+    /// \brief Allocates GameStates from a fixed buffer, in a stack-like fashion
+    ///
+    /// GameStates are allocated by bumping the top of the arena, which
+    /// matches the order GameStates are pushed and popped on a stack.
+    /// A GameState that is destroyed whilst above it there are GameStates
+    /// that are still alive (e.g. when it is removed from the middle of the
+    /// stack) only has its memory reclaimed once those are destroyed.
+    /// When the arena is full, GameStates are allocated from the heap.
+    class ArenaStateAllocator : public StateAllocator
+    {
+    public:
+
+        /// \param capacity The size of the arena, in bytes
+        explicit ArenaStateAllocator(std::size_t capacity) :
+            _buffer(new unsigned char[capacity]),
+            _capacity(capacity),
+            _top(0),
+            _lastBlock(NO_BLOCK)
+        {
+        }
+
+        ArenaStateAllocator(const ArenaStateAllocator&) = delete;
+        ArenaStateAllocator& operator=(const ArenaStateAllocator&) = delete;
+
+        /// \return The size of the arena, in bytes
+        std::size_t getCapacity() const { return _capacity; }
+
+        /// \return The amount of bytes used in the arena (including memory waiting to be reclaimed)
+        std::size_t getUsedBytes() const { return _top; }
+
+    private:
+
+        static const std::size_t NO_BLOCK = static_cast<std::size_t>(-1);
+
+        // placed before each block in the arena
+        struct BlockHeader
+        {
+            /// The top of the arena before the block was allocated
+            std::size_t previousTop;
+
+            /// The offset of the block allocated before this block
+            std::size_t previousBlock;
+
+            /// true if the block has been deallocated
+            bool isFree;
+        };
+
+        BlockHeader& header(std::size_t block)
+        {
+            return *reinterpret_cast<BlockHeader*>(_buffer.get() + block - sizeof(BlockHeader));
+        }
+
+        bool owns(void* memory) const
+        {
+            unsigned char* bytes = static_cast<unsigned char*>(memory);
+            return bytes >= _buffer.get() && bytes < _buffer.get() + _capacity;
+        }
+
+        virtual void* doAllocate(std::size_t size, std::size_t alignment) override
+        {
+            std::size_t alignTo = alignment > alignof(BlockHeader) ? alignment : alignof(BlockHeader);
+            std::uintptr_t base = reinterpret_cast<std::uintptr_t>(_buffer.get());
+            std::uintptr_t start = base + _top + sizeof(BlockHeader);
+            std::uintptr_t aligned = (start + alignTo - 1) / alignTo * alignTo;
+            std::size_t block = static_cast<std::size_t>(aligned - base);
+
+            if(block + size > _capacity)
+            {
+                onHeapFallback();
+                return ::operator new(size);
+            }
+
+            BlockHeader& blockHeader = header(block);
+            blockHeader.previousTop = _top;
+            blockHeader.previousBlock = _lastBlock;
+            blockHeader.isFree = false;
+
+            _top = block + size;
+            _lastBlock = block;
+
+            return _buffer.get() + block;
+        }
+
+        virtual void doDeallocate(void* memory, std::size_t size, std::size_t alignment) override
+        {
+            if(!owns(memory))
+            {
+                ::operator delete(memory);
+                return;
+            }
+
+            header(static_cast<std::size_t>(static_cast<unsigned char*>(memory) - _buffer.get())).isFree = true;
+
+            // reclaim every free block on the top of the arena
+            while(_lastBlock != NO_BLOCK && header(_lastBlock).isFree)
+            {
+                BlockHeader& blockHeader = header(_lastBlock);
+                _top = blockHeader.previousTop;
+                _lastBlock = blockHeader.previousBlock;
+            }
+        }
+
+        std::unique_ptr<unsigned char[]> _buffer;
+        std::size_t _capacity;
+
+        /// The offset of the top of the arena
+        std::size_t _top;
+
+        /// The offset of the block that was allocated last (and is not reclaimed)
+        std::size_t _lastBlock;
+    };
+}
+
+#endif // PINE_STATE_ALLOCATOR_HPP
@@ -29,9 +29,15 @@
 #ifndef PINE_STATED_GAME_HPP
 #define PINE_STATED_GAME_HPP
 
+#include <vector>
+#include <cstdint>
+#include <typeinfo>
+#include <type_traits>
+
 #include <pine/Game.hpp>
 #include <pine/GameState.hpp>
 #include <pine/GameStateStack.hpp>
+#include <pine/RenderPipeline.hpp>
 
 namespace pine
 {
@@ -52,7 +58,13 @@ namespace pine
         StateStack& getStateStack() { return _stack; }
         const StateStack& getStateStack() const { return _stack; }
 
-        StatedGame() : _stack(*static_cast<TGame*>(this)) { }
+        StatedGame() :
+            _transitionLogger(*this),
+            _stack(*static_cast<TGame*>(this))
+        {
+            _stack.addListener(&_transitionLogger);
+            _stack.setTimerWheel(&this->getTimers());
+        }
 
         void onConfigureEngine()
         {
@@ -61,24 +73,92 @@ namespace pine
 
         void onInit(int argc, char* argv[])
         {
+            shareJobSystem(std::is_void<TEngine>());
             thisType()->onInit(argc, argv);
         }
 
         void onFrameStart()
         {
+            _stack.activateLoadedStates();
             thisType()->onFrameStart();
         }
 
         void onUpdate(pine::Seconds deltaTime)
         {
+            if(_stack.getRollbackWindow() > 0)
+            {
+                _stack.saveTick();
+            }
+
+            dispatchEvents();
             thisType()->onUpdate(deltaTime);
             _stack.update(deltaTime);
         }
 
-        void onFrameEnd()
+        void onFrameEnd(Real interpolation)
+        {
+            if(_stack.getRenderPipeline())
+            {
+                _stack.produceSnapshots(interpolation);
+            }
+            else
+            {
+                _stack.render(interpolation);
+            }
+            thisType()->onFrameEnd(interpolation);
+        }
+
+        /// Sets the pipeline used to render on another thread (see RunPipelinedGame)
+        /// \param pipeline The pipeline, or null to render at the end of each frame
+        void setRenderPipeline(RenderPipeline* pipeline)
+        {
+            _stack.setRenderPipeline(pipeline);
+        }
+
+        /// Renders a frame produced by the simulation, this is called on the render thread
+        /// \param slot The slot of the pipeline being rendered
+        /// \param interpolation How far the frame is between its previous and its next update
+        void renderFrame(std::size_t slot, Real interpolation)
         {
-            _stack.render();
-            thisType()->onFrameEnd();
+            _stack.consumeSnapshots(slot, interpolation);
+            thisType()->onRenderFrame(interpolation);
+        }
+
+        /// Rewinds the game to how it was at the start of a tick,
+        /// and updates the game again until it is back at the current tick
+        ///
+        /// What pine keeps for the game is rewound with the stack: the GameStates
+        /// (including those removed since the tick), the game's timers, and the
+        /// events routed in each tick, which are routed again as the ticks are
+        /// updated again (see isResimulating).
+        ///
+        /// \param tick The tick to roll back to
+        /// \param deltaTime The time step of each update
+        /// \return true if the game was rolled back, false if the tick is not kept
+        /// \see GameStateStack::setRollbackWindow
+        /// \note The game must rewind anything else it changes in onUpdate() itself (e.g. its
+        ///       own inputs of the ticks being replayed), and this must not be called whilst
+        ///       the game is updating (e.g. call it in onFrameStart())
+        bool rollback(Tick tick, Seconds deltaTime)
+        {
+            Tick currentTick = _stack.getTick();
+            if(!_stack.rewind(tick)) return false;
+
+            this->setResimulating(true);
+            try
+            {
+                while(_stack.getTick() < currentTick)
+                {
+                    this->update(deltaTime);
+                }
+            }
+            catch(...)
+            {
+                this->setResimulating(false);
+                throw;
+            }
+            this->setResimulating(false);
+            return true;
         }
 
         void onWillQuit(int errorCode)
@@ -88,9 +168,82 @@ namespace pine
 
     private:
 
+        /// Records the transitions of the stack in the game's tick log (see TickLog)
+        struct TransitionLogger : GameStateStackListener<StateStack>
+        {
+            explicit TransitionLogger(StatedGame& game) : game(game) { }
+
+            void log(StackTransition transition, const char* stateName)
+            {
+                if(game.isResimulating()) return;
+                if(TickLog* tickLog = game.getTickLog()) tickLog->transition(transition, stateName);
+            }
+
+            virtual void onGameStateWasPushed(StateStack& sender, State& gameState) override { log(StackTransition::Push, typeid(gameState).name()); }
+            virtual void onGameStateWillBeRemoved(StateStack& sender, State& gameState) override { log(StackTransition::Remove, typeid(gameState).name()); }
+            virtual void onStackWillBePopped(StateStack& sender) override { log(StackTransition::Pop, ""); }
+            virtual void onStackWillBeCleared(StateStack& sender) override { log(StackTransition::Clear, ""); }
+
+            StatedGame& game;
+        };
+
+        /// Routes the events posted since the last update to the stack
+        ///
+        /// The events are logged as inputs, so whilst replaying (see TickLog)
+        /// the recorded events are routed instead of the posted ones. Only the
+        /// events posted before the update started are routed, the events posted
+        /// whilst routing are left for the next update. The routed events are
+        /// kept with the tick's saved state (see GameStateStack::getSavedEvents),
+        /// and whilst resimulating (see rollback) the tick's kept events are
+        /// routed again rather than the posted ones.
+        void dispatchEvents()
+        {
+            std::vector<GameEvent>* savedEvents = _stack.getSavedEvents();
+            if(this->isResimulating())
+            {
+                if(!savedEvents) return;
+                for(auto& event : *savedEvents)
+                {
+                    _stack.dispatch(event);
+                }
+                return;
+            }
+            if(savedEvents) savedEvents->clear();
+
+            TickLog* tickLog = this->getTickLog();
+            bool isReplaying = tickLog && tickLog->isReplaying();
+
+            std::size_t remaining = isReplaying ? 0 : this->getEvents().getPendingCount();
+
+            GameEvent event;
+            for(;;)
+            {
+                std::uint8_t hasEvent = remaining > 0 && this->getEvents().take(event);
+                if(hasEvent) --remaining;
+                if(tickLog)
+                {
+                    this->logInput(hasEvent);
+                    if(hasEvent) this->logInput(event);
+                }
+
+                if(!hasEvent) break;
+                if(savedEvents) savedEvents->push_back(event);
+                _stack.dispatch(event);
+            }
+        }
+
+        /// Has the stack update its independent GameStates with the engine's jobs, rather than threads of its own
+        void shareJobSystem(std::false_type) { _stack.setUpdater(&this->getEngine().getJobSystem()); }
+
+        /// A game without an engine, the stack creates a job system of its own
+        void shareJobSystem(std::true_type) { }
+
         Game* thisType() { return static_cast<Game*>(this); }
         const Game* thisType() const { return static_cast<const Game*>(this); }
 
+        // declared before the stack, which notifies it until it is destroyed
+        TransitionLogger _transitionLogger;
+
         StateStack _stack;
     };
 }
@@ -0,0 +1,673 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_STATIC_GAME_STATE_STACK_HPP
+#define PINE_STATIC_GAME_STATE_STACK_HPP
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+#include <cassert>
+
+#include <pine/Types.hpp>
+#include <pine/GameStateStack.hpp>
+#include <pine/Profiler.hpp>
+
+namespace pine
+{
+    template <class TGame, class... TStates>
+    class StaticGameStateStack;
+
+    /// \brief Describes a state in your game, that is stored in a StaticGameStateStack
+    /// \tparam TGame Your game
+    ///
+    /// Unlike GameState, a StaticGameState has no virtual functions: the
+    /// StaticGameStateStack knows the concrete type of every state on it, and
+    /// calls the state's functions directly. A state hides the functions
+    /// below that it wishes to handle, by declaring a public function with
+    /// the same name and signature.
+    ///
+    /// \author Miguel Martin
+    template <class TGame>
+    class StaticGameState
+    {
+    public:
+
+        using Game = TGame;
+
+        template <class, class...>
+        friend class StaticGameStateStack;
+
+        /// Default constructor
+        StaticGameState() :
+            _game(nullptr)
+        {
+        }
+
+        /// \return The Game attached to the state
+        Game& getGame()
+        { return *_game; }
+
+        /// \return The Game attached to the state
+        const Game& getGame() const
+        { return *_game; }
+
+        void init() {}
+        void loadResources() {}
+        void unloadResources() {}
+        void update(pine::Seconds deltaTime) {}
+        void render(Real interpolation) {}
+
+        // Events
+        void onPause() { }
+        void onResume() { }
+
+    protected:
+
+        // states are destroyed through their concrete type
+        ~StaticGameState() = default;
+
+    private:
+
+        /// The game attached to the state
+        Game* _game; // guaranteed to not be null
+    };
+
+    namespace detail
+    {
+        template <std::size_t A, std::size_t B>
+        struct static_max : std::integral_constant<std::size_t, (A > B ? A : B)> {};
+
+        template <class... Ts>
+        struct max_size_of;
+
+        template <class T>
+        struct max_size_of<T> : std::integral_constant<std::size_t, sizeof(T)> {};
+
+        template <class T, class... Ts>
+        struct max_size_of<T, Ts...> : static_max<sizeof(T), max_size_of<Ts...>::value> {};
+
+        template <class... Ts>
+        struct max_align_of;
+
+        template <class T>
+        struct max_align_of<T> : std::integral_constant<std::size_t, alignof(T)> {};
+
+        template <class T, class... Ts>
+        struct max_align_of<T, Ts...> : static_max<alignof(T), max_align_of<Ts...>::value> {};
+
+        /// The index of T within Ts
+        template <class T, class... Ts>
+        struct index_of;
+
+        template <class T, class... Ts>
+        struct index_of<T, T, Ts...> : std::integral_constant<std::size_t, 0> {};
+
+        template <class T, class U, class... Ts>
+        struct index_of<T, U, Ts...> : std::integral_constant<std::size_t, 1 + index_of<T, Ts...>::value> {};
+
+        template <class T, class... Ts>
+        struct contains : std::false_type {};
+
+        template <class T, class U, class... Ts>
+        struct contains<T, U, Ts...> : std::integral_constant<bool, std::is_same<T, U>::value || contains<T, Ts...>::value> {};
+
+        template <class TBase, class... Ts>
+        struct all_derive_from : std::true_type {};
+
+        template <class TBase, class T, class... Ts>
+        struct all_derive_from<TBase, T, Ts...> : std::integral_constant<bool, std::is_base_of<TBase, T>::value && all_derive_from<TBase, Ts...>::value> {};
+
+        /// Calls f with the object of type Ts[index] stored at memory.
+        /// This expands to a chain of comparisons, rather than a table of
+        /// function pointers, so that f may be inlined.
+        template <std::size_t I, class... Ts>
+        struct static_visitor
+        {
+            template <class F>
+            static void visit(std::size_t, void*, F&) { assert(false && "Invalid state index"); }
+        };
+
+        template <std::size_t I, class T, class... Ts>
+        struct static_visitor<I, T, Ts...>
+        {
+            template <class F>
+            static void visit(std::size_t index, void* memory, F& f)
+            {
+                if(index == I)
+                {
+                    f(*static_cast<T*>(memory));
+                }
+                else
+                {
+                    static_visitor<I + 1, Ts...>::visit(index, memory, f);
+                }
+            }
+        };
+    }
+
+    /// \brief Resembles a stack of game states, over a closed set of state types
+    /// \tparam TGame Your game
+    /// \tparam TStates Every type of state that may be pushed on the stack, each must derive from StaticGameState<TGame>
+    ///
+    /// A StaticGameStateStack behaves like a GameStateStack (the same PushTypes
+    /// and the same listeners), but stores its states in-place, in slots large
+    /// enough for any of TStates, and calls their functions without virtual
+    /// dispatch. The slots are allocated once, when the stack is constructed;
+    /// pushing a state never allocates.
+    ///
+    /// Changes made to the stack whilst it is updating or rendering are applied,
+    /// in order, once it has finished.
+    ///
+    /// \author Miguel Martin
+    template <class TGame, class... TStates>
+    class StaticGameStateStack
+    {
+    public:
+
+        using Game = TGame;
+        using ThisType = StaticGameStateStack<Game, TStates...>;
+        using State = StaticGameState<Game>;
+        using Listener = GameStateStackListener<ThisType>;
+
+        static_assert(sizeof...(TStates) > 0, "A StaticGameStateStack requires at least one type of state");
+
+        /// \param game The game the states are attached to
+        /// \param capacity The maximum amount of states on the stack at once
+        explicit StaticGameStateStack(Game& game, std::size_t capacity = 8) :
+            _slots(new Slot[capacity]),
+            _capacity(capacity),
+            _iterationDepth(0),
+            _game(&game)
+        {
+            // checked here, so that the states may be incomplete where the stack is declared
+            static_assert(detail::all_derive_from<State, TStates...>::value, "Every state must derive from StaticGameState<TGame>");
+
+            _stack.reserve(capacity);
+            _freeSlots.reserve(capacity);
+            for(std::size_t i = capacity; i-- > 0;)
+            {
+                _freeSlots.push_back(i);
+            }
+        }
+
+        StaticGameStateStack(const StaticGameStateStack&) = delete;
+        StaticGameStateStack& operator=(const StaticGameStateStack&) = delete;
+
+        ~StaticGameStateStack()
+        {
+            for(auto& change : _pendingChanges)
+            {
+                if(change.type == Change::Type::Push)
+                {
+                    destroy(change.slot, false);
+                }
+            }
+            _pendingChanges.clear();
+
+            clear();
+        }
+
+        /// Constructs a GameState in-place, and pushes it on the stack
+        /// \param args The arguments to construct the GameState with
+        template <class TGameState, class... Args>
+        TGameState& push(Args&&... args)
+        {
+            return push<TGameState, PushType::Default>(std::forward<Args>(args)...);
+        }
+
+        /// Constructs a GameState in-place, and pushes it on the stack
+        /// \tparam Push The PushType that you wish to push the GameState with
+        /// \param args The arguments to construct the GameState with
+        /// \return The GameState, which is only loaded once it is on the stack
+        template <class TGameState, PushType Push, class... Args>
+        TGameState& push(Args&&... args)
+        {
+            static_assert(detail::contains<TGameState, TStates...>::value, "The state is not one of the stack's states");
+
+            if(_freeSlots.empty())
+            {
+                throw std::length_error("StaticGameStateStack is full");
+            }
+
+            std::size_t slot = _freeSlots.back();
+            TGameState* gameState = new(&_slots[slot].storage) TGameState(std::forward<Args>(args)...);
+            _freeSlots.pop_back();
+
+            _slots[slot].typeIndex = detail::index_of<TGameState, TStates...>::value;
+            _slots[slot].pushType = Push;
+
+            if(isDeferringChanges())
+            {
+                _pendingChanges.push_back(Change{Change::Type::Push, slot});
+            }
+            else
+            {
+                pushSlot(slot);
+            }
+
+            return *gameState;
+        }
+
+        /// Pops the GameState stack
+        void pop()
+        {
+            if(isDeferringChanges())
+            {
+                _pendingChanges.push_back(Change{Change::Type::Pop, 0});
+                return;
+            }
+
+            if(_stack.empty()) return;
+
+            for(auto& listener : _listeners)
+            {
+                listener->onStackWillBePopped(*this);
+            }
+
+            std::size_t slot = _stack.back();
+            bool wasSilent = _slots[slot].pushType == PushType::PushWithoutPoppingSilenty;
+
+            _stack.pop_back();
+            destroy(slot, true);
+
+            // call onResume on every other state in the stack that was on previous top
+            if(!wasSilent)
+            {
+                ResumeVisitor resume;
+                perform_f_on_stack(resume);
+            }
+        }
+
+        /// Updates the necessary GameStates in the stack
+        void update(Seconds deltaTime)
+        {
+            PINE_PROFILE_ZONE("StaticGameStateStack::update");
+
+            UpdateVisitor update{deltaTime};
+            perform_f_on_stack(update);
+
+            applyPendingChanges();
+        }
+
+        /// Renders the necessary GameStates in the stack
+        /// \param interpolation How far the game is between its last update and its next update, in the range [0, 1)
+        void render(Real interpolation)
+        {
+            PINE_PROFILE_ZONE("StaticGameStateStack::render");
+
+            RenderVisitor render{interpolation};
+            perform_f_on_stack(render);
+
+            applyPendingChanges();
+        }
+
+        /// Clears the StaticGameStateStack
+        void clear()
+        {
+            if(isDeferringChanges())
+            {
+                _pendingChanges.push_back(Change{Change::Type::Clear, 0});
+                return;
+            }
+
+            for(auto& listener : _listeners)
+            {
+                listener->onStackWillBeCleared(*this);
+            }
+
+            std::vector<std::size_t> stack;
+            stack.swap(_stack);
+            for(std::size_t slot : stack)
+            {
+                destroy(slot, true);
+            }
+            stack.clear();
+            stack.swap(_stack); // keep the reserved memory
+        }
+
+        /// Removes a GameState from the stack
+        /// \param gameState The GameState you wish to remove
+        void remove(State* gameState)
+        {
+            assert(gameState);
+
+            if(isDeferringChanges())
+            {
+                Change change{Change::Type::Remove, 0};
+                change.target = gameState;
+                _pendingChanges.push_back(change);
+                return;
+            }
+
+            auto elementToRemove = std::find_if(_stack.begin(), _stack.end(), [&](std::size_t slot) { return stateAt(slot) == gameState; });
+
+            if(elementToRemove == _stack.end())
+                return;
+
+            for(auto& listener : _listeners)
+            {
+                listener->onGameStateWillBeRemoved(*this, *gameState);
+            }
+
+            std::size_t slot = *elementToRemove;
+            _stack.erase(elementToRemove);
+            destroy(slot, true);
+        }
+
+        /// Applies the changes made to the stack whilst it was being iterated
+        /// This is called by update() and render().
+        void applyPendingChanges()
+        {
+            if(isDeferringChanges()) return;
+
+            while(!_pendingChanges.empty())
+            {
+                std::vector<Change> changes;
+                changes.swap(_pendingChanges);
+
+                for(auto& change : changes)
+                {
+                    switch(change.type)
+                    {
+                        case Change::Type::Push:
+                            pushSlot(change.slot);
+                            break;
+                        case Change::Type::Pop:
+                            pop();
+                            break;
+                        case Change::Type::Remove:
+                            remove(change.target);
+                            break;
+                        case Change::Type::Clear:
+                            clear();
+                            break;
+                    }
+                }
+
+                for(auto& listener : _listeners)
+                {
+                    listener->onStackChanged(*this);
+                }
+
+                if(_pendingChanges.empty())
+                {
+                    // keep the reserved memory
+                    changes.clear();
+                    _pendingChanges.swap(changes);
+                }
+            }
+        }
+
+        /// \return true if there are changes waiting to be applied
+        bool hasPendingChanges() const { return !_pendingChanges.empty(); }
+
+        /// \return The amount of GameStates on the stack
+        std::size_t size() const { return _stack.size(); }
+
+        /// \return The maximum amount of GameStates on the stack at once
+        std::size_t capacity() const { return _capacity; }
+
+        /// \return The Game the GameStates are attached to
+        Game& getGame() { return *_game; }
+        const Game& getGame() const { return *_game; }
+
+        void addListener(Listener* listener)
+        {
+            _listeners.push_back(listener);
+        }
+
+        void removeListener(Listener* listener)
+        {
+            _listeners.erase(std::remove(_listeners.begin(), _listeners.end(), listener), _listeners.end());
+        }
+
+    private:
+
+        struct Slot
+        {
+            typename std::aligned_storage<detail::max_size_of<TStates...>::value,
+                                          detail::max_align_of<TStates...>::value>::type storage;
+            std::size_t typeIndex;
+            PushType pushType;
+        };
+
+        // a change to the stack that has been deferred
+        struct Change
+        {
+            enum class Type
+            {
+                Push,
+                Pop,
+                Remove,
+                Clear
+            };
+
+            Change(Type type, std::size_t slot) :
+                type(type),
+                slot(slot),
+                target(nullptr)
+            {
+            }
+
+            Type type;
+
+            /// The slot of the GameState to push
+            std::size_t slot;
+
+            /// The GameState to remove
+            State* target;
+        };
+
+        struct UpdateVisitor
+        {
+            Seconds deltaTime;
+
+            template <class T>
+            void operator()(T& state) const
+            {
+                PINE_PROFILE_ZONE_TYPE("GameState::update", state);
+                state.update(deltaTime);
+            }
+        };
+
+        struct RenderVisitor
+        {
+            Real interpolation;
+
+            template <class T>
+            void operator()(T& state) const
+            {
+                PINE_PROFILE_ZONE_TYPE("GameState::render", state);
+                state.render(interpolation);
+            }
+        };
+
+        struct PauseVisitor
+        {
+            template <class T>
+            void operator()(T& state) const { state.onPause(); }
+        };
+
+        struct ResumeVisitor
+        {
+            template <class T>
+            void operator()(T& state) const { state.onResume(); }
+        };
+
+        struct StartVisitor
+        {
+            template <class T>
+            void operator()(T& state) const
+            {
+                PINE_PROFILE_ZONE_TYPE("GameState::loadResources", state);
+                state.loadResources();
+                state.init();
+            }
+        };
+
+        struct DestroyVisitor
+        {
+            bool unloadResources;
+
+            template <class T>
+            void operator()(T& state) const
+            {
+                if(unloadResources)
+                {
+                    state.unloadResources();
+                }
+                state.~T();
+            }
+        };
+
+        struct BaseVisitor
+        {
+            State* state;
+
+            template <class T>
+            void operator()(T& derived) { state = &derived; }
+        };
+
+        template <class F>
+        void visit(std::size_t slot, F& f)
+        {
+            detail::static_visitor<0, TStates...>::visit(_slots[slot].typeIndex, &_slots[slot].storage, f);
+        }
+
+        State* stateAt(std::size_t slot)
+        {
+            BaseVisitor base{nullptr};
+            visit(slot, base);
+            return base.state;
+        }
+
+        template <typename F>
+        void perform_f_on_stack(F& f)
+        {
+            // changes made to the stack whilst we iterate are deferred
+            ++_iterationDepth;
+
+            // we're going to loop through the stack backwards
+            // if the top is silently pushed on, we will iterate again
+            for(std::size_t i = _stack.size(); i-- > 0;)
+            {
+                visit(_stack[i], f);
+
+                // if we no longer need to continue to iterate
+                if(_slots[_stack[i]].pushType != PushType::PushWithoutPoppingSilenty)
+                {
+                    break;
+                }
+            }
+
+            --_iterationDepth;
+        }
+
+        bool isDeferringChanges() const { return _iterationDepth > 0; }
+
+        /// Pushes a constructed GameState on the stack, and starts it
+        void pushSlot(std::size_t slot)
+        {
+            State* gameState = stateAt(slot);
+            PushType pushType = _slots[slot].pushType;
+
+            for(auto& listener : _listeners)
+            {
+                listener->onGameStateWillBePushed(*this, *gameState);
+            }
+
+            if(pushType == PushType::PushAndPop)
+            {
+                pop();
+            }
+            else if(pushType == PushType::PushAndPopAllPreviousStates)
+            {
+                clear();
+            }
+
+            if(pushType != PushType::PushWithoutPoppingSilenty)
+            {
+                PauseVisitor pause;
+                perform_f_on_stack(pause);
+            }
+
+            _stack.push_back(slot);
+            gameState->_game = _game;
+
+            StartVisitor start;
+            visit(slot, start);
+
+            ResumeVisitor resume;
+            visit(slot, resume);
+
+            for(auto& listener : _listeners)
+            {
+                listener->onGameStateWasPushed(*this, *gameState);
+            }
+        }
+
+        /// Destroys the GameState in a slot, and frees the slot
+        void destroy(std::size_t slot, bool unloadResources)
+        {
+            DestroyVisitor destroy{unloadResources};
+            visit(slot, destroy);
+            _freeSlots.push_back(slot);
+        }
+
+        /// The listeners of this StaticGameStateStack
+        std::vector<Listener*> _listeners;
+
+        /// Storage for the GameStates, allocated once
+        std::unique_ptr<Slot[]> _slots;
+        std::size_t _capacity;
+
+        /// The slots of the GameStates on the stack, from the bottom up
+        std::vector<std::size_t> _stack;
+
+        /// The slots which are not in use
+        std::vector<std::size_t> _freeSlots;
+
+        /// Changes to the stack that have been deferred whilst it is being iterated
+        std::vector<Change> _pendingChanges;
+
+        /// How many times the stack is being iterated over
+        unsigned _iterationDepth;
+
+        /// The game the GameStates are attached to
+        Game* _game;
+    };
+}
+
+#endif // PINE_STATIC_GAME_STATE_STACK_HPP
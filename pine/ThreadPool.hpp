@@ -0,0 +1,159 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+#ifndef PINE_THREAD_POOL_HPP
+#define PINE_THREAD_POOL_HPP
+
+#include <queue>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <utility>
+#include <functional>
+#include <condition_variable>
+
+#include <cassert>
+
+#include <pine/Profiler.hpp>
+
+namespace pine
+{
+    /// \brief A fixed-size pool of worker threads
+    ///
+    /// Tasks are executed in the order they are enqueued, by whichever
+    /// worker becomes free first. The pool is meant for long running
+    /// background work (such as loading resources) that must not stall
+    /// the game loop.
+    ///
+    /// \author Miguel Martin
+    class ThreadPool
+    {
+    public:
+
+        /// \return The default amount of worker threads for a pool
+        static std::size_t defaultThreadCount()
+        {
+            std::size_t hardwareThreads = std::thread::hardware_concurrency();
+            return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        /// \param threadCount The amount of worker threads to spawn
+        explicit ThreadPool(std::size_t threadCount = defaultThreadCount()) :
+            _isStopping(false)
+        {
+            assert(threadCount > 0 && "A ThreadPool requires at least one thread");
+
+            _workers.reserve(threadCount);
+            for(std::size_t i = 0; i < threadCount; ++i)
+            {
+                _workers.emplace_back([this]() { workerLoop(); });
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /// Finishes all enqueued tasks and joins the worker threads
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _isStopping = true;
+            }
+            _condition.notify_all();
+
+            for(auto& worker : _workers)
+            {
+                worker.join();
+            }
+        }
+
+        /// Enqueues a task to be executed on a worker thread
+        /// \param task The task you wish to execute
+        /// \return A future to the result of the task, any exception
+        ///         thrown by the task is re-thrown when the result is retrieved
+        template <class F>
+        std::future<decltype(std::declval<F&>()())> enqueue(F task)
+        {
+            using Result = decltype(std::declval<F&>()());
+
+            auto packagedTask = std::make_shared<std::packaged_task<Result()> >(std::move(task));
+            auto result = packagedTask->get_future();
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                assert(!_isStopping && "Cannot enqueue a task on a stopping ThreadPool");
+                _tasks.emplace([packagedTask]() { (*packagedTask)(); });
+            }
+            _condition.notify_one();
+
+            return result;
+        }
+
+        /// \return The amount of worker threads in the pool
+        std::size_t getThreadCount() const { return _workers.size(); }
+
+    private:
+
+        void workerLoop()
+        {
+            PINE_PROFILE_THREAD("ThreadPool worker");
+
+            for(;;)
+            {
+                std::function<void()> task;
+
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _condition.wait(lock, [this]() { return _isStopping || !_tasks.empty(); });
+
+                    if(_tasks.empty()) return; // only occurs when we are stopping
+
+                    task = std::move(_tasks.front());
+                    _tasks.pop();
+                }
+
+                task();
+            }
+        }
+
+        /// The worker threads
+        std::vector<std::thread> _workers;
+
+        /// Tasks that are waiting to be executed
+        std::queue<std::function<void()> > _tasks;
+
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        bool _isStopping;
+    };
+}
+
+#endif // PINE_THREAD_POOL_HPP
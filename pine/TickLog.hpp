@@ -0,0 +1,539 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+
+#ifndef PINE_TICKLOG_HPP
+#define PINE_TICKLOG_HPP
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#   define PINE_TICKLOG_USE_MMAP
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+
+#include <pine/Types.hpp>
+
+namespace pine
+{
+    /// \brief A change to a GameStateStack, as recorded in a TickLog
+    enum class StackTransition : std::uint8_t
+    {
+        Push,
+        Pop,
+        Remove,
+        Clear
+    };
+
+    /// \brief A step of the game loop read back from a TickLog
+    struct TickLogStep
+    {
+        enum class Type
+        {
+            /// The game was updated by deltaTime
+            Tick,
+
+            /// A frame ended, with interpolation
+            FrameEnd
+        };
+
+        Type type;
+        Seconds deltaTime;
+        Real interpolation;
+    };
+
+    namespace detail
+    {
+        /// \brief A file mapped into memory, which is grown as it is written to
+        ///
+        /// Where memory mapping is not available, the file is kept in memory,
+        /// and written out when it is closed.
+        class MappedFile
+        {
+        public:
+
+            MappedFile() :
+                _data(nullptr),
+                _capacity(0),
+                _isWritable(false),
+                _file(-1)
+            {
+            }
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            ~MappedFile() { close(0); }
+
+            /// Creates (or truncates) a file to write to
+            /// \param capacity The size to map up front, in bytes
+            /// \return true if the file was created
+            bool create(const std::string& path, std::size_t capacity)
+            {
+                _path = path;
+                _isWritable = true;
+#ifdef PINE_TICKLOG_USE_MMAP
+                _file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+                if(_file < 0) return false;
+#else
+                std::FILE* file = std::fopen(path.c_str(), "wb");
+                if(!file) return false;
+                std::fclose(file);
+#endif
+                return reserve(capacity);
+            }
+
+            /// Opens a file to read
+            /// \return true if the file was opened
+            bool open(const std::string& path)
+            {
+                _path = path;
+                _isWritable = false;
+#ifdef PINE_TICKLOG_USE_MMAP
+                _file = ::open(path.c_str(), O_RDONLY);
+                if(_file < 0) return false;
+
+                struct stat status;
+                if(::fstat(_file, &status) != 0 || status.st_size == 0) return false;
+
+                void* data = ::mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, _file, 0);
+                if(data == MAP_FAILED) return false;
+
+                _data = static_cast<unsigned char*>(data);
+                _capacity = status.st_size;
+#else
+                std::FILE* file = std::fopen(path.c_str(), "rb");
+                if(!file) return false;
+
+                unsigned char buffer[4096];
+                std::size_t count;
+                while((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+                {
+                    _buffer.insert(_buffer.end(), buffer, buffer + count);
+                }
+                std::fclose(file);
+
+                _data = _buffer.data();
+                _capacity = _buffer.size();
+#endif
+                return true;
+            }
+
+            /// Grows the mapping of a file that is being written to
+            /// \param capacity The size the mapping must have at least, in bytes
+            /// \return true if the mapping is at least that large
+            bool reserve(std::size_t capacity)
+            {
+                if(capacity <= _capacity) return true;
+#ifdef PINE_TICKLOG_USE_MMAP
+                if(_data) ::munmap(_data, _capacity);
+                _data = nullptr;
+
+                if(::ftruncate(_file, capacity) != 0) return false;
+
+                void* data = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _file, 0);
+                if(data == MAP_FAILED) return false;
+
+                _data = static_cast<unsigned char*>(data);
+#else
+                _buffer.resize(capacity);
+                _data = _buffer.data();
+#endif
+                _capacity = capacity;
+                return true;
+            }
+
+            /// Unmaps and closes the file
+            /// \param size The amount of bytes written, which the file is truncated to
+            void close(std::size_t size)
+            {
+#ifdef PINE_TICKLOG_USE_MMAP
+                if(_data) ::munmap(_data, _capacity);
+                if(_file >= 0)
+                {
+                    // if truncating fails, the unwritten end of the file is zeroed, which ends the log anyway
+                    if(_isWritable && ::ftruncate(_file, size) != 0) { }
+                    ::close(_file);
+                }
+#else
+                if(_isWritable && _data)
+                {
+                    if(std::FILE* file = std::fopen(_path.c_str(), "wb"))
+                    {
+                        std::fwrite(_data, 1, size, file);
+                        std::fclose(file);
+                    }
+                }
+                _buffer.clear();
+#endif
+                _data = nullptr;
+                _capacity = 0;
+                _file = -1;
+            }
+
+            unsigned char* data() const { return _data; }
+            std::size_t capacity() const { return _capacity; }
+            bool isOpen() const { return _data != nullptr; }
+
+        private:
+
+            unsigned char* _data;
+            std::size_t _capacity;
+            bool _isWritable;
+            int _file;
+            std::string _path;
+
+            /// Holds the file where memory mapping is not available
+            std::vector<unsigned char> _buffer;
+        };
+    }
+
+    /// \brief Records the ticks of a game into a file, and reads them back to replay the game
+    ///
+    /// Whilst recording, each update (its delta time), each end of a frame (its
+    /// interpolation), the inputs the game logs with Game::logInput() and the
+    /// transitions of a StatedGame's stack are appended to a memory mapped file,
+    /// so recording a tick is little more than a memcpy.
+    ///
+    /// Whilst replaying (see ReplayGame), the recorded inputs are handed back to
+    /// the game in place of its own, and the transitions of the stack are compared
+    /// to the recorded ones. If the game asks for an input that was not recorded,
+    /// or the stack changes differently, the replay has diverged (hasDiverged()).
+    ///
+    /// The ticks a StatedGame updates again after a rollback (see StatedGame::rollback)
+    /// are not recorded, nor read back whilst replaying: only the real ticks are in the
+    /// log, and a replayed game that rolls back resimulates from its own inputs, as
+    /// it did whilst it was recorded.
+    ///
+    /// \note The inputs are recorded as raw bytes, so a log may only be replayed
+    ///       by the same build of the game, on the same platform
+    class TickLog
+    {
+    public:
+
+        TickLog() :
+            _mode(Mode::Closed),
+            _size(0),
+            _position(0),
+            _tickCount(0),
+            _divergedTick(0),
+            _hasDiverged(false)
+        {
+        }
+
+        TickLog(const TickLog&) = delete;
+        TickLog& operator=(const TickLog&) = delete;
+
+        ~TickLog() { close(); }
+
+        /// Starts recording to a file, closing the log first if it is open
+        /// \param path The file to record to, it is overwritten if it exists
+        /// \param capacity The size of the file to map up front, it is doubled whenever it is full
+        /// \return true if the file was created
+        bool record(const std::string& path, std::size_t capacity = 1 << 20)
+        {
+            close();
+
+            if(!_file.create(path, std::max<std::size_t>(capacity, HEADER_SIZE)))
+            {
+                _file.close(0);
+                return false;
+            }
+
+            std::memcpy(_file.data(), magic(), HEADER_SIZE);
+            _size = HEADER_SIZE;
+            _mode = Mode::Recording;
+            return true;
+        }
+
+        /// Opens a recorded file to replay, closing the log first if it is open
+        /// \param path The file to replay
+        /// \return true if the file is a tick log
+        bool replay(const std::string& path)
+        {
+            close();
+
+            if(!_file.open(path) || _file.capacity() < HEADER_SIZE || std::memcmp(_file.data(), magic(), HEADER_SIZE) != 0)
+            {
+                _file.close(0);
+                return false;
+            }
+
+            _size = _file.capacity();
+            _position = HEADER_SIZE;
+            _mode = Mode::Replaying;
+            return true;
+        }
+
+        /// Closes the log, a recorded file is truncated to what was recorded
+        void close()
+        {
+            _file.close(_size);
+            _mode = Mode::Closed;
+            _size = 0;
+            _position = 0;
+            _tickCount = 0;
+            _divergedTick = 0;
+            _hasDiverged = false;
+        }
+
+        bool isRecording() const { return _mode == Mode::Recording; }
+        bool isReplaying() const { return _mode == Mode::Replaying; }
+
+        /// \return The amount of ticks recorded or replayed
+        Tick getTickCount() const { return _tickCount; }
+
+        /// \return The amount of bytes recorded, or the size of the replayed file
+        std::size_t getSize() const { return _size; }
+
+        /// \return true if the game did not do what was recorded whilst replaying
+        bool hasDiverged() const { return _hasDiverged; }
+
+        /// \return The first tick the replay diverged on, counting from 0
+        Tick getDivergedTick() const { return _divergedTick; }
+
+        /// Records the start of an update, this is called by Game::update
+        void beginTick(Seconds deltaTime)
+        {
+            if(_mode != Mode::Recording) return;
+
+            double time = deltaTime;
+            write(RecordType::Tick, &time, sizeof(time));
+            ++_tickCount;
+        }
+
+        /// Records the end of a frame, this is called by Game::frameEnd
+        void endFrame(Real interpolation)
+        {
+            if(_mode != Mode::Recording) return;
+
+            double value = interpolation;
+            write(RecordType::FrameEnd, &value, sizeof(value));
+        }
+
+        /// Records an input of the current tick, or replaces it with the recorded input whilst replaying
+        /// \param data The input
+        /// \param size The size of the input, in bytes
+        void input(void* data, std::size_t size)
+        {
+            if(_mode == Mode::Recording)
+            {
+                write(RecordType::Input, data, size);
+            }
+            else if(_mode == Mode::Replaying)
+            {
+                const unsigned char* payload = nullptr;
+                if(read(RecordType::Input, payload) == size)
+                {
+                    std::memcpy(data, payload, size);
+                }
+                else
+                {
+                    diverge();
+                }
+            }
+        }
+
+        /// Records a transition of the stack, or compares it to the recorded transition whilst replaying
+        /// \param transition The transition
+        /// \param stateName The name of the type of the GameState it concerns (may be empty)
+        void transition(StackTransition transition, const char* stateName)
+        {
+            if(_mode == Mode::Closed) return;
+
+            std::size_t nameLength = std::strlen(stateName);
+            if(_mode == Mode::Recording)
+            {
+                unsigned char* payload = beginWrite(RecordType::Transition, 1 + nameLength);
+                payload[0] = static_cast<unsigned char>(transition);
+                std::memcpy(payload + 1, stateName, nameLength);
+                return;
+            }
+
+            const unsigned char* payload = nullptr;
+            std::size_t size = read(RecordType::Transition, payload);
+            if(size != 1 + nameLength || payload[0] != static_cast<unsigned char>(transition) || std::memcmp(payload + 1, stateName, nameLength) != 0)
+            {
+                diverge();
+            }
+        }
+
+        /// Reads the next update or end of a frame whilst replaying, skipping
+        /// the inputs and transitions the game did not replay
+        /// \return false if the end of the log has been reached
+        bool readStep(TickLogStep& step)
+        {
+            while(_mode == Mode::Replaying && _position + sizeof(RecordHeader) <= _size)
+            {
+                RecordHeader header;
+                std::memcpy(&header, _file.data() + _position, sizeof(header));
+                if(header.type == 0 || _position + sizeof(header) + header.size > _size) break;
+
+                const unsigned char* payload = _file.data() + _position + sizeof(header);
+                _position += sizeof(header) + padded(header.size);
+
+                double value;
+                switch(static_cast<RecordType>(header.type))
+                {
+                    case RecordType::Tick:
+                        std::memcpy(&value, payload, sizeof(value));
+                        step.type = TickLogStep::Type::Tick;
+                        step.deltaTime = static_cast<Seconds>(value);
+                        step.interpolation = 0;
+                        ++_tickCount;
+                        return true;
+                    case RecordType::FrameEnd:
+                        std::memcpy(&value, payload, sizeof(value));
+                        step.type = TickLogStep::Type::FrameEnd;
+                        step.deltaTime = 0;
+                        step.interpolation = static_cast<Real>(value);
+                        return true;
+                    default:
+                        // recorded, but not replayed by the game
+                        diverge();
+                        break;
+                }
+            }
+            return false;
+        }
+
+    private:
+
+        enum class Mode
+        {
+            Closed,
+            Recording,
+            Replaying
+        };
+
+        enum class RecordType : std::uint32_t
+        {
+            Tick = 1,
+            FrameEnd,
+            Input,
+            Transition
+        };
+
+        struct RecordHeader
+        {
+            std::uint32_t type;
+            std::uint32_t size;
+        };
+
+        enum { HEADER_SIZE = 16 };
+
+        /// \return The header that identifies a file as a tick log (and its version)
+        static const char* magic() { return "PINETLOG0001\0\0\0"; }
+
+        /// \return The size of a payload, padded so that the next record is aligned
+        static std::size_t padded(std::size_t size)
+        {
+            return (size + sizeof(RecordHeader) - 1) / sizeof(RecordHeader) * sizeof(RecordHeader);
+        }
+
+        void write(RecordType type, const void* data, std::size_t size)
+        {
+            std::memcpy(beginWrite(type, size), data, size);
+        }
+
+        /// Appends a record to the file, growing it if it is full
+        /// \return Where the record's payload is written to
+        unsigned char* beginWrite(RecordType type, std::size_t size)
+        {
+            std::size_t recordSize = sizeof(RecordHeader) + padded(size);
+            if(_size + recordSize > _file.capacity())
+            {
+                if(!_file.reserve(std::max(_file.capacity() * 2, _size + recordSize)))
+                {
+                    throw std::runtime_error("Could not grow the tick log");
+                }
+            }
+
+            RecordHeader header = { static_cast<std::uint32_t>(type), static_cast<std::uint32_t>(size) };
+            unsigned char* record = _file.data() + _size;
+            std::memcpy(record, &header, sizeof(header));
+            _size += recordSize;
+            return record + sizeof(header);
+        }
+
+        /// Reads the next record whilst replaying, if it is of a type
+        /// \param payload Set to the record's payload
+        /// \return The size of the payload, or -1 if the next record is of another type
+        std::size_t read(RecordType type, const unsigned char*& payload)
+        {
+            if(_position + sizeof(RecordHeader) > _size) return static_cast<std::size_t>(-1);
+
+            RecordHeader header;
+            std::memcpy(&header, _file.data() + _position, sizeof(header));
+            if(header.type != static_cast<std::uint32_t>(type) || _position + sizeof(header) + header.size > _size)
+            {
+                return static_cast<std::size_t>(-1);
+            }
+
+            payload = _file.data() + _position + sizeof(header);
+            _position += sizeof(header) + padded(header.size);
+            return header.size;
+        }
+
+        void diverge()
+        {
+            if(_hasDiverged) return;
+
+            _hasDiverged = true;
+            _divergedTick = _tickCount > 0 ? _tickCount - 1 : 0;
+        }
+
+        Mode _mode;
+
+        /// The recorded (or replayed) file
+        detail::MappedFile _file;
+
+        /// The amount of bytes recorded, or the size of the replayed file
+        std::size_t _size;
+
+        /// Where the next record is read from whilst replaying
+        std::size_t _position;
+
+        Tick _tickCount;
+        Tick _divergedTick;
+        bool _hasDiverged;
+    };
+}
+
+#endif // PINE_TICKLOG_HPP
@@ -29,8 +29,8 @@
 #ifndef PINE_UTILS_HPP
 #define PINE_UTILS_HPP
 
-#include <pine/config.hpp>
-#include <pine/types.hpp>
+#include <pine/Config.hpp>
+#include <pine/Types.hpp>
 
 #ifdef PINE_USE_BOOST_CHRONO
 #	include <boost/chrono.hpp>
@@ -40,8 +40,26 @@
 
 namespace pine
 {
-    /// \return The user's time in seconds
-    inline Seconds time_now()
+    /// The amount of nanoseconds in a second
+    const Nanoseconds NANOSECONDS_PER_SECOND = 1000000000;
+
+    /// \param nanoseconds A duration in nanoseconds
+    /// \return The duration in seconds
+    inline Seconds to_seconds(Nanoseconds nanoseconds)
+    {
+        return static_cast<Seconds>(nanoseconds / NANOSECONDS_PER_SECOND)
+             + static_cast<Seconds>(nanoseconds % NANOSECONDS_PER_SECOND) / NANOSECONDS_PER_SECOND;
+    }
+
+    /// \param seconds A duration in seconds
+    /// \return The duration in nanoseconds, rounded to the nearest nanosecond
+    inline Nanoseconds to_nanoseconds(Seconds seconds)
+    {
+        return static_cast<Nanoseconds>(seconds * NANOSECONDS_PER_SECOND + (seconds < 0 ? -Seconds(0.5) : Seconds(0.5)));
+    }
+
+    /// \return The time of a steady (monotonic) clock, in nanoseconds
+    inline Nanoseconds time_now_ns()
     {
 #	ifdef PINE_USE_BOOST_CHRONO
         using namespace boost;
@@ -49,7 +67,13 @@ namespace pine
         using namespace std;
 #	endif // PINE_USE_BOOST_CHRONO
 
-        return chrono::duration_cast<chrono::duration<Seconds, std::ratio<1> > >(chrono::high_resolution_clock::now().time_since_epoch()).count();
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// \return The time of a steady (monotonic) clock, in seconds
+    inline Seconds time_now()
+    {
+        return to_seconds(time_now_ns());
     }
 }
 
@@ -0,0 +1,467 @@
+///
+/// pine
+/// Copyright (C) 2014 Miguel Martin (miguel@miguel-martin.com)
+///
+///
+/// This software is provided 'as-is', without any express or implied warranty.
+/// In no event will the authors be held liable for any damages arising from the
+/// use of this software.
+///
+/// Permission is hereby granted, free of charge, to any person
+/// obtaining a copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// 1. The origin of this software must not be misrepresented;
+///    you must not claim that you wrote the original software.
+///    If you use this software in a product, an acknowledgment
+///    in the product documentation would be appreciated but is not required.
+///
+/// 2. Altered source versions must be plainly marked as such,
+///	   and must not be misrepresented as being the original software.
+///
+/// 3. The above copyright notice and this permission notice shall be included in
+///    all copies or substantial portions of the Software.
+///
+
+
+#ifndef PINE_TIMER_WHEEL_HPP
+#define PINE_TIMER_WHEEL_HPP
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+
+#include <cassert>
+
+#include <pine/Types.hpp>
+
+namespace pine
+{
+    /// \brief Refers to a timer scheduled with a TimerWheel
+    ///
+    /// A handle stays safe to use once its timer has fired or been cancelled,
+    /// it simply no longer refers to a scheduled timer.
+    struct TimerHandle
+    {
+        TimerHandle() :
+            index(0),
+            generation(0)
+        {
+        }
+
+        TimerHandle(std::uint32_t index, std::uint32_t generation) :
+            index(index),
+            generation(generation)
+        {
+        }
+
+        std::uint32_t index;
+
+        /// 0 for a handle that refers to no timer
+        std::uint32_t generation;
+    };
+
+    /// \brief Schedules callbacks to be called after an amount of ticks
+    ///
+    /// A hierarchical timing wheel: four wheels of 256 slots each, where a timer
+    /// is put into the wheel of the finest resolution that covers how far away
+    /// it is, and is moved into finer wheels as its time comes closer. Scheduling
+    /// and cancelling take constant time, and advancing a tick only touches the
+    /// timers that are due (plus, every 256 ticks, a slot of a coarser wheel).
+    ///
+    /// A game's wheel (see Game::getTimers) is advanced once after each update.
+    /// Timers may be bound to an owner (e.g. a GameState), to cancel every timer
+    /// of the owner at once; a GameStateStack cancels the timers bound to a
+    /// GameState when it leaves the stack (see GameStateStack::setTimerWheel).
+    /// A wheel may be saved into a Snapshot and restored from it, which the
+    /// stack does with each tick it keeps to roll back to.
+    ///
+    /// \note A TimerWheel may only be used from the thread running the game loop
+    class TimerWheel
+    {
+    public:
+
+        using Callback = std::function<void()>;
+
+        /// \brief A copy of the timers of a wheel, see save and restore
+        class Snapshot;
+
+        TimerWheel() :
+            _tick(0),
+            _tickDuration(1.0 / 60),
+            _free(NONE),
+            _timerCount(0)
+        {
+            _heads.assign(LIST_COUNT, std::uint32_t(NONE));
+        }
+
+        TimerWheel(const TimerWheel&) = delete;
+        TimerWheel& operator=(const TimerWheel&) = delete;
+
+        /// Schedules a callback to be called once
+        /// \param ticks The amount of ticks until the callback is called (at least 1)
+        /// \param callback The callback
+        /// \param owner What the timer is bound to, see cancelAll (may be null)
+        TimerHandle after(Tick ticks, Callback callback, const void* owner = nullptr)
+        {
+            return schedule(ticks, 0, std::move(callback), owner);
+        }
+
+        /// Schedules a callback to be called repeatedly, until it is cancelled
+        /// \param ticks The amount of ticks between each call (at least 1)
+        /// \param callback The callback
+        /// \param owner What the timer is bound to, see cancelAll (may be null)
+        TimerHandle every(Tick ticks, Callback callback, const void* owner = nullptr)
+        {
+            ticks = ticks > 0 ? ticks : 1;
+            return schedule(ticks, ticks, std::move(callback), owner);
+        }
+
+        /// Schedules a callback to be called once, after an amount of time
+        /// rounded up to a whole amount of ticks
+        TimerHandle afterSeconds(Seconds seconds, Callback callback, const void* owner = nullptr)
+        {
+            return after(toTicks(seconds), std::move(callback), owner);
+        }
+
+        /// Schedules a callback to be called repeatedly, with an amount of time
+        /// between each call rounded up to a whole amount of ticks
+        TimerHandle everySeconds(Seconds seconds, Callback callback, const void* owner = nullptr)
+        {
+            return every(toTicks(seconds), std::move(callback), owner);
+        }
+
+        /// Cancels a timer
+        /// \return true if the timer was scheduled
+        bool cancel(TimerHandle handle)
+        {
+            if(!isScheduled(handle)) return false;
+
+            release(handle.index);
+            return true;
+        }
+
+        /// Cancels every timer bound to an owner
+        /// \param owner The owner
+        void cancelAll(const void* owner)
+        {
+            auto timers = _owners.find(owner);
+            if(timers == _owners.end()) return;
+
+            std::uint32_t index = timers->second;
+            _owners.erase(timers);
+
+            while(index != NONE)
+            {
+                std::uint32_t next = _timers[index].nextOfOwner;
+                _timers[index].owner = nullptr;
+                release(index);
+                index = next;
+            }
+        }
+
+        /// \return true if a timer has neither fired (if it is not repeating) nor been cancelled
+        bool isScheduled(TimerHandle handle) const
+        {
+            return handle.generation != 0 && handle.index < _timers.size() && _timers[handle.index].generation == handle.generation && _timers[handle.index].list != NONE;
+        }
+
+        /// Advances the wheel by a tick, calling the callbacks that are due.
+        /// This is called after each update of the game.
+        /// \param deltaTime The duration of the tick, used to schedule timers in seconds
+        void advance(Seconds deltaTime)
+        {
+            if(deltaTime > 0) _tickDuration = deltaTime;
+            ++_tick;
+
+            // move the timers of the coarser wheels into the finer wheels as they come closer
+            for(unsigned wheel = 1; wheel < WHEEL_COUNT && (_tick & ((Tick(1) << (SLOT_BITS * wheel)) - 1)) == 0; ++wheel)
+            {
+                std::uint32_t list = listOf(wheel, _tick);
+                std::uint32_t index = _heads[list];
+                _heads[list] = NONE;
+
+                while(index != NONE)
+                {
+                    std::uint32_t next = _timers[index].next;
+                    insert(index);
+                    index = next;
+                }
+            }
+
+            // the due timers are moved to their own list, so callbacks may cancel any timer
+            std::uint32_t due = listOf(0, _tick);
+            std::swap(_heads[FIRING], _heads[due]);
+            for(std::uint32_t index = _heads[FIRING]; index != NONE; index = _timers[index].next)
+            {
+                _timers[index].list = FIRING;
+            }
+
+            while(_heads[FIRING] != NONE)
+            {
+                std::uint32_t index = _heads[FIRING];
+                unlink(index);
+
+                Timer& timer = _timers[index];
+                std::uint32_t generation = timer.generation;
+                timer.list = CALLING;
+
+                // the callback may schedule timers, which may move the timers in memory
+                Callback callback = std::move(timer.callback);
+                callback();
+
+                Timer& called = _timers[index];
+                if(called.generation != generation) continue; // cancelled by the callback
+
+                if(called.period > 0)
+                {
+                    called.callback = std::move(callback);
+                    called.expiry += called.period;
+                    insert(index);
+                }
+                else
+                {
+                    release(index);
+                }
+            }
+        }
+
+        /// Saves the timers of the wheel, reusing the memory of the snapshot
+        /// \param snapshot The snapshot to save to
+        void save(Snapshot& snapshot) const
+        {
+            snapshot.timers = _timers;
+            snapshot.heads = _heads;
+            snapshot.owners = _owners;
+            snapshot.tick = _tick;
+            snapshot.tickDuration = _tickDuration;
+            snapshot.free = _free;
+            snapshot.timerCount = _timerCount;
+        }
+
+        /// Restores the timers of the wheel to how they were when they were saved,
+        /// the handles returned since then refer to the timers they referred to then
+        /// \param snapshot The snapshot to restore
+        /// \note This must not be called from a timer's callback
+        void restore(const Snapshot& snapshot)
+        {
+            _timers = snapshot.timers;
+            _heads = snapshot.heads;
+            _owners = snapshot.owners;
+            _tick = snapshot.tick;
+            _tickDuration = snapshot.tickDuration;
+            _free = snapshot.free;
+            _timerCount = snapshot.timerCount;
+        }
+
+        /// \return The amount of ticks the wheel has been advanced by
+        Tick getTick() const { return _tick; }
+
+        /// \return The amount of timers that are scheduled
+        std::size_t getTimerCount() const { return _timerCount; }
+
+    private:
+
+        static const std::uint32_t NONE = 0xffffffff;
+
+        static const unsigned SLOT_BITS = 8;
+        static const unsigned SLOT_COUNT = 1 << SLOT_BITS;
+        static const unsigned WHEEL_COUNT = 4;
+
+        /// The lists of the wheels' slots, then the lists of timers being fired
+        static const std::uint32_t FIRING = WHEEL_COUNT * SLOT_COUNT;
+        static const std::uint32_t LIST_COUNT = FIRING + 1;
+
+        /// The list of a timer whose callback is being called
+        static const std::uint32_t CALLING = LIST_COUNT;
+
+        struct Timer
+        {
+            Callback callback;
+            Tick expiry;
+            Tick period;
+            const void* owner;
+
+            /// The timer's list (NONE if it is not scheduled), and its neighbours in it
+            std::uint32_t list;
+            std::uint32_t previous;
+            std::uint32_t next;
+
+            /// The timer's neighbours in the list of its owner's timers
+            std::uint32_t previousOfOwner;
+            std::uint32_t nextOfOwner;
+
+            /// Incremented each time the timer is released
+            std::uint32_t generation;
+        };
+
+    public:
+
+        class Snapshot
+        {
+        public:
+
+            Snapshot() :
+                tick(0),
+                tickDuration(0),
+                free(NONE),
+                timerCount(0)
+            {
+            }
+
+        private:
+
+            friend class TimerWheel;
+
+            std::vector<Timer> timers;
+            std::vector<std::uint32_t> heads;
+            std::unordered_map<const void*, std::uint32_t> owners;
+            Tick tick;
+            Seconds tickDuration;
+            std::uint32_t free;
+            std::size_t timerCount;
+        };
+
+    private:
+
+        static std::uint32_t listOf(unsigned wheel, Tick tick)
+        {
+            return static_cast<std::uint32_t>(wheel * SLOT_COUNT + ((tick >> (SLOT_BITS * wheel)) & (SLOT_COUNT - 1)));
+        }
+
+        Tick toTicks(Seconds seconds) const
+        {
+            Seconds ticks = std::ceil(seconds / _tickDuration - Seconds(1e-6));
+            return ticks > 1 ? static_cast<Tick>(ticks) : 1;
+        }
+
+        TimerHandle schedule(Tick ticks, Tick period, Callback callback, const void* owner)
+        {
+            std::uint32_t index = acquire();
+            Timer& timer = _timers[index];
+            timer.callback = std::move(callback);
+            timer.expiry = _tick + (ticks > 0 ? ticks : 1);
+            timer.period = period;
+            timer.owner = owner;
+            timer.previousOfOwner = NONE;
+            timer.nextOfOwner = NONE;
+
+            if(owner)
+            {
+                auto timers = _owners.insert(std::make_pair(owner, std::uint32_t(NONE))).first;
+                timer.nextOfOwner = timers->second;
+                if(timers->second != NONE) _timers[timers->second].previousOfOwner = index;
+                timers->second = index;
+            }
+
+            insert(index);
+            ++_timerCount;
+            return TimerHandle(index, timer.generation);
+        }
+
+        /// Puts a timer into the slot of the finest wheel that covers how far away it is
+        void insert(std::uint32_t index)
+        {
+            Tick expiry = _timers[index].expiry;
+            Tick delta = expiry - _tick;
+
+            unsigned wheel = 0;
+            while(wheel + 1 < WHEEL_COUNT && delta >= (Tick(1) << (SLOT_BITS * (wheel + 1))))
+            {
+                ++wheel;
+            }
+
+            // further away than the coarsest wheel covers, it is put back in when the wheel comes round
+            Tick maxDelta = (Tick(1) << (SLOT_BITS * WHEEL_COUNT)) - (Tick(1) << (SLOT_BITS * (WHEEL_COUNT - 1)));
+            if(delta > maxDelta) expiry = _tick + maxDelta;
+
+            link(index, listOf(wheel, expiry));
+        }
+
+        void link(std::uint32_t index, std::uint32_t list)
+        {
+            Timer& timer = _timers[index];
+            timer.list = list;
+            timer.previous = NONE;
+            timer.next = _heads[list];
+            if(timer.next != NONE) _timers[timer.next].previous = index;
+            _heads[list] = index;
+        }
+
+        void unlink(std::uint32_t index)
+        {
+            Timer& timer = _timers[index];
+            if(timer.list >= LIST_COUNT) return;
+
+            if(timer.previous != NONE) _timers[timer.previous].next = timer.next;
+            else _heads[timer.list] = timer.next;
+            if(timer.next != NONE) _timers[timer.next].previous = timer.previous;
+            timer.list = NONE;
+        }
+
+        std::uint32_t acquire()
+        {
+            if(_free == NONE)
+            {
+                assert(_timers.size() < NONE && "Too many timers");
+                _timers.push_back(Timer());
+                _timers.back().generation = 1;
+                _timers.back().list = NONE;
+                return static_cast<std::uint32_t>(_timers.size() - 1);
+            }
+
+            std::uint32_t index = _free;
+            _free = _timers[index].next;
+            return index;
+        }
+
+        /// Unschedules a timer, and puts it back in the pool
+        void release(std::uint32_t index)
+        {
+            unlink(index);
+
+            Timer& timer = _timers[index];
+            if(timer.owner)
+            {
+                if(timer.previousOfOwner != NONE) _timers[timer.previousOfOwner].nextOfOwner = timer.nextOfOwner;
+                else if(timer.nextOfOwner != NONE) _owners[timer.owner] = timer.nextOfOwner;
+                else _owners.erase(timer.owner);
+                if(timer.nextOfOwner != NONE) _timers[timer.nextOfOwner].previousOfOwner = timer.previousOfOwner;
+            }
+
+            timer.callback = nullptr;
+            timer.owner = nullptr;
+            timer.list = NONE;
+            if(++timer.generation == 0) timer.generation = 1;
+            timer.next = _free;
+            _free = index;
+            --_timerCount;
+        }
+
+        /// Every timer, scheduled or free
+        std::vector<Timer> _timers;
+
+        /// The first timer of each list (see listOf)
+        std::vector<std::uint32_t> _heads;
+
+        /// The first timer bound to each owner
+        std::unordered_map<const void*, std::uint32_t> _owners;
+
+        Tick _tick;
+        Seconds _tickDuration;
+
+        /// The first free timer
+        std::uint32_t _free;
+
+        std::size_t _timerCount;
+    };
+}
+
+#endif // PINE_TIMER_WHEEL_HPP
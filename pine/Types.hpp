@@ -29,13 +29,18 @@
 #ifndef PINE_TYPES_HPP
 #define PINE_TYPES_HPP
 
-#include <pine/config.hpp>
+#include <cstdint>
+
+#include <pine/Config.hpp>
 
 namespace pine
 {
     /// The unit used for Frames Per Second
     typedef unsigned int FramesPerSecond;
 
+    /// The unit used for the amount of updates (ticks) per second
+    typedef unsigned int TicksPerSecond;
+
 #if (PINE_FLOATING_POINT_PERCISION == PINE_FLOATING_POINT_DOUBLE)
     typedef double Real;
 #else
@@ -44,6 +49,12 @@ namespace pine
 
     /// The unit for seconds
     typedef Real Seconds;
+
+    /// The unit for nanoseconds, used to keep time exactly
+    typedef std::int64_t Nanoseconds;
+
+    /// The unit used to count updates (ticks) of a game
+    typedef std::uint64_t Tick;
 }
 
 #endif // PINE_TYPES_HPP
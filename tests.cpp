@@ -0,0 +1,1015 @@
+/// Checks behaviour of pine that is easy to get wrong, each test prints
+/// its name and whether it passed; the program fails if any test fails.
+///
+/// Build with, e.g.
+///
+///     c++ -std=c++11 -pthread -I. tests.cpp -o pine_tests
+
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pine/StatedGame.hpp>
+#include <pine/GameHost.hpp>
+#include <pine/StaticGameStateStack.hpp>
+
+namespace
+{
+    int failureCount = 0;
+
+    void check(bool condition, const char* test, const char* description)
+    {
+        if(!condition)
+        {
+            std::cout << test << ": FAILED " << description << '\n';
+            ++failureCount;
+        }
+    }
+}
+
+struct TestGame : pine::StatedGame<TestGame>
+{
+    void onConfigureEngine() { }
+    void onInit(int argc, char* argv[]) { }
+    void onFrameStart() { }
+    void onUpdate(pine::Seconds deltaTime) { }
+    void onFrameEnd(pine::Real interpolation) { }
+    void onWillQuit(int errorCode) { }
+};
+
+struct FailingLoadState : public TestGame::State
+{
+private:
+
+    virtual void loadResources() override { throw std::runtime_error("failed to load"); }
+};
+
+static void testFailedAsyncLoadReleasesHandle()
+{
+    const char* test = "stack/failed_async_load_releases_handle";
+
+    TestGame game;
+    TestGame::StateStack stack(game);
+    stack.setLoaderThreadCount(1);
+
+    pine::GameStateHandle handle = stack.pushAsync<FailingLoadState>();
+    check(stack.isAlive(handle), test, "the handle is alive whilst loading");
+
+    bool threw = false;
+    while(stack.isLoading())
+    {
+        try
+        {
+            stack.activateLoadedStates();
+        }
+        catch(const std::runtime_error&)
+        {
+            threw = true;
+        }
+    }
+
+    check(threw, test, "the loading error is re-thrown");
+    check(!stack.isAlive(handle), test, "the handle is no longer alive");
+    check(stack.get(handle) == nullptr, test, "get() returns null");
+    check(!stack.remove(handle), test, "remove() does nothing");
+    std::cout << test << '\n';
+}
+
+// counts the times its timer fires, which is rolled back
+typedef pine::RollbackGameState<TestGame, int> CountingRollbackState;
+
+static void testRollbackRewindsTimers()
+{
+    const char* test = "rollback/rewinds_timers";
+
+    TestGame game;
+    game.getStateStack().setRollbackWindow(16);
+    CountingRollbackState* state = new CountingRollbackState;
+    game.getStateStack().push(state);
+    game.getTimers().every(5, [state]() { ++state->getData(); }, state);
+
+    for(int i = 0; i < 20; ++i) game.update(1.0 / 60);
+    check(state->getData() == 4, test, "the timer fires every 5 ticks");
+
+    game.rollback(game.getStateStack().getTick() - 8, 1.0 / 60);
+    check(state->getData() == 4, test, "the timer fires again whilst resimulating");
+
+    for(int i = 0; i < 4; ++i) game.update(1.0 / 60);
+    check(state->getData() == 4, test, "the timer does not fire early");
+
+    game.update(1.0 / 60);
+    check(state->getData() == 5, test, "the timer fires on the tick it is due");
+    std::cout << test << '\n';
+}
+
+static void testRollbackRestoresRemovedStates()
+{
+    const char* test = "rollback/restores_removed_states";
+
+    TestGame game;
+    TestGame::StateStack& stack = game.getStateStack();
+    stack.setRollbackWindow(16);
+    CountingRollbackState* state = new CountingRollbackState;
+    pine::GameStateHandle handle = stack.push(state);
+    game.getTimers().every(2, [state]() { ++state->getData(); }, state);
+
+    for(int i = 0; i < 4; ++i) game.update(1.0 / 60);
+    stack.remove(handle);
+    check(!stack.isAlive(handle), test, "the handle of a removed state is not alive");
+
+    for(int i = 0; i < 4; ++i) game.update(1.0 / 60);
+    check(state->getData() == 2 && game.getTimers().getTimerCount() == 0, test, "the timers of a removed state are cancelled");
+
+    check(game.rollback(stack.getTick() - 6, 1.0 / 60), test, "the stack is rolled back to before the state was removed");
+    check(state->getData() == 4, test, "the timers of a state that is put back on the stack fire again");
+    check(!stack.isAlive(handle), test, "a state that is put back has a new handle");
+
+    // removed, and put back, again
+    stack.remove(state);
+    for(int i = 0; i < 2; ++i) game.update(1.0 / 60);
+    check(game.rollback(stack.getTick() - 3, 1.0 / 60), test, "the stack is rolled back again");
+    check(state->getData() == 5 && game.getTimers().getTimerCount() == 1, test, "the state is put back again");
+    std::cout << test << '\n';
+}
+
+// logs an input each tick
+struct LoggingGame : pine::StatedGame<LoggingGame>
+{
+    void onConfigureEngine() { }
+    void onInit(int argc, char* argv[]) { }
+    void onFrameStart() { }
+    void onUpdate(pine::Seconds deltaTime)
+    {
+        int input = 1;
+        logInput(input);
+    }
+    void onFrameEnd(pine::Real interpolation) { }
+    void onWillQuit(int errorCode) { }
+};
+
+// rolls the game back 8 ticks after its 12th tick
+static void updateLoggingGame(LoggingGame& game, pine::Tick tickCount, pine::Seconds deltaTime)
+{
+    game.update(deltaTime);
+    if(tickCount == 12) game.rollback(game.getStateStack().getTick() - 8, deltaTime);
+}
+
+static void testRollbackIsNotRecorded()
+{
+    const char* test = "ticklog/rollback_is_not_recorded";
+    const char* path = "pine_tests.pinelog";
+
+    {
+        pine::TickLog log;
+        check(log.record(path), test, "the log is created");
+
+        LoggingGame game;
+        game.setTickLog(&log);
+        game.getStateStack().setRollbackWindow(16);
+        for(pine::Tick tick = 1; tick <= 16; ++tick)
+        {
+            updateLoggingGame(game, tick, 1.0 / 60);
+        }
+        check(log.getTickCount() == 16, test, "only the real ticks are recorded");
+
+        // the stack is cleared when the game is destroyed, which is not replayed
+        game.setTickLog(nullptr);
+    }
+
+    {
+        pine::TickLog log;
+        check(log.replay(path), test, "the log is opened");
+
+        LoggingGame game;
+        game.setTickLog(&log);
+        game.getStateStack().setRollbackWindow(16);
+
+        pine::Tick tickCount = 0;
+        pine::TickLogStep step;
+        while(log.readStep(step))
+        {
+            if(step.type == pine::TickLogStep::Type::Tick)
+            {
+                updateLoggingGame(game, ++tickCount, step.deltaTime);
+            }
+        }
+        check(tickCount == 16, test, "only the real ticks are replayed");
+        check(!log.hasDiverged(), test, "the replay does not diverge");
+    }
+
+    std::remove(path);
+    std::cout << test << '\n';
+}
+
+// counts the events it is handed, which is rolled back, and posts another event for each
+struct RepostingState : public pine::RollbackGameState<TestGame, int>
+{
+private:
+
+    virtual bool onEvent(const pine::GameEvent& event) override
+    {
+        ++getData();
+
+        // the events posted the first time the tick was updated are routed again
+        if(!getGame().isResimulating()) getGame().getEvents().post(event);
+        return true;
+    }
+};
+
+static void testEventsAreRoutedOnce()
+{
+    const char* test = "events/routed_once";
+
+    TestGame game;
+    game.getStateStack().setRollbackWindow(16);
+    RepostingState* state = new RepostingState;
+    game.getStateStack().push(state);
+
+    game.getEvents().post(1, 0);
+    game.update(1.0 / 60);
+    check(state->getData() == 1, test, "an event posted whilst routing waits for the next update");
+
+    for(int i = 0; i < 3; ++i) game.update(1.0 / 60);
+    check(state->getData() == 4, test, "an event is routed each update");
+
+    game.rollback(game.getStateStack().getTick() - 3, 1.0 / 60);
+    check(state->getData() == 4, test, "the events of the resimulated ticks are routed again");
+    check(game.getEvents().getPendingCount() == 1, test, "the posted event is left for the next update");
+
+    game.update(1.0 / 60);
+    check(state->getData() == 5, test, "the posted event is routed after the rollback");
+    std::cout << test << '\n';
+}
+
+// sleeps for half a second after each update
+struct SleepingState : public TestGame::State
+{
+    SleepingState() : updateCount(0), updatedTime(0) { }
+
+    int updateCount;
+    pine::Seconds updatedTime;
+
+private:
+
+    virtual void update(pine::Seconds deltaTime) override
+    {
+        ++updateCount;
+        updatedTime += deltaTime;
+        sleepFor(0.5);
+    }
+};
+
+static void testSleepingStateIsNotUpdated()
+{
+    const char* test = "stack/sleeping_state_is_not_updated";
+
+    TestGame game;
+    SleepingState* state = new SleepingState;
+    game.getStateStack().push(state);
+
+    for(int i = 0; i < 4; ++i) game.update(0.125);
+    check(state->updateCount == 1, test, "the state is not updated whilst it sleeps");
+
+    game.update(0.125);
+    check(state->updateCount == 2, test, "the state is updated once it has slept");
+    check(state->updatedTime == 0.625, test, "the state is given the time it slept through");
+    std::cout << test << '\n';
+}
+
+// counts its updates, which may be run on another thread
+struct IndependentState : public TestGame::State
+{
+    IndependentState() : updateCount(0), shouldThrow(false) { }
+
+    int updateCount;
+    bool shouldThrow;
+
+private:
+
+    virtual void update(pine::Seconds deltaTime) override
+    {
+        ++updateCount;
+        if(shouldThrow) throw std::runtime_error("failed to update");
+    }
+
+    virtual bool hasIndependentUpdate() const override { return true; }
+};
+
+static void testIndependentStatesAreUpdated()
+{
+    const char* test = "stack/independent_states_are_updated";
+
+    TestGame game;
+    game.getStateStack().setUpdaterThreadCount(2);
+
+    IndependentState* states[8];
+    for(auto& state : states)
+    {
+        state = new IndependentState;
+        game.getStateStack().push(state, pine::PushType::PushWithoutPoppingSilenty);
+    }
+
+    for(int i = 0; i < 10; ++i) game.update(1.0 / 60);
+
+    bool isEachUpdated = true;
+    for(auto state : states) isEachUpdated = isEachUpdated && state->updateCount == 10;
+    check(isEachUpdated, test, "each state is updated once per tick");
+
+    states[3]->shouldThrow = true;
+    bool threw = false;
+    try
+    {
+        game.update(1.0 / 60);
+    }
+    catch(const std::runtime_error&)
+    {
+        threw = true;
+    }
+    check(threw, test, "the exception of an update is re-thrown");
+    check(states[7]->updateCount == 11, test, "the other states are still updated");
+    std::cout << test << '\n';
+}
+
+static void testProfileBuffersAreRecycled()
+{
+    const char* test = "profiler/buffers_are_recycled";
+
+    pine::Profiler& profiler = pine::Profiler::instance();
+    pine::ProfileBuffer* buffers[2];
+    for(auto& buffer : buffers)
+    {
+        std::thread thread([&buffer, &profiler]()
+        {
+            buffer = &profiler.getThreadBuffer();
+            profiler.setThreadName("profiled");
+            pine::ProfileZone zone("zone");
+        });
+        thread.join();
+    }
+
+    check(buffers[0] == buffers[1], test, "the buffer of an exited thread is reused");
+    check(buffers[1]->getThreadName() == "profiled", test, "the buffer is named by the thread using it");
+
+    std::vector<pine::ProfileEvent> events;
+    buffers[1]->copyTo(events);
+    check(events.size() == 1, test, "the zones of the exited thread are not kept by the next thread");
+    std::cout << test << '\n';
+}
+
+static void testProfilerExportsWhilstRecording()
+{
+    const char* test = "profiler/export_whilst_recording";
+
+    pine::ProfileBuffer buffer(64, 0);
+    std::atomic<bool> isDone(false);
+    std::thread recorder([&buffer, &isDone]()
+    {
+        for(std::uint32_t i = 0; i < 100000; ++i)
+        {
+            pine::ProfileEvent event = { "zone", nullptr, i, 1, i % 4 };
+            buffer.push(event);
+        }
+        isDone = true;
+    });
+
+    bool isOrdered = true;
+    std::vector<pine::ProfileEvent> events;
+    while(!isDone)
+    {
+        events.clear();
+        buffer.copyTo(events);
+        for(std::size_t i = 1; i < events.size(); ++i)
+        {
+            if(events[i].start <= events[i - 1].start || events[i].depth != events[i].start % 4) isOrdered = false;
+        }
+        check(events.size() <= 64, test, "no more zones are exported than the buffer keeps");
+    }
+    recorder.join();
+    check(isOrdered, test, "the exported zones are whole, and oldest first");
+
+    events.clear();
+    buffer.copyTo(events);
+    check(events.size() == 64 && events.back().start == 99999, test, "the newest zones are kept");
+
+    buffer.clear();
+    events.clear();
+    buffer.copyTo(events);
+    check(events.empty(), test, "cleared zones are not exported");
+    std::cout << test << '\n';
+}
+
+// records what a stack tells its listeners
+struct RecordingListener : pine::GameStateStackListener<TestGame::StateStack>
+{
+    std::string calls;
+
+    virtual void onGameStateWillBePushed(TestGame::StateStack& sender, TestGame::State& gameState) override { calls += "push "; }
+    virtual void onGameStateWillBeRemoved(TestGame::StateStack& sender, TestGame::State& gameState) override { calls += "remove "; }
+    virtual void onStackWillBePopped(TestGame::StateStack& sender) override { calls += "pop "; }
+    virtual void onStackWillBeCleared(TestGame::StateStack& sender) override { calls += "clear "; }
+};
+
+// how a CountingState was started and stopped, which outlives the state
+struct StateCounts
+{
+    StateCounts() : initCount(0), pauseCount(0), resumeCount(0) { }
+
+    int initCount;
+    int pauseCount;
+    int resumeCount;
+};
+
+struct CountingState : public TestGame::State
+{
+    explicit CountingState(StateCounts& counts) : counts(counts) { }
+
+    StateCounts& counts;
+
+private:
+
+    virtual void init() override { ++counts.initCount; }
+    virtual void onPause() override { ++counts.pauseCount; }
+    virtual void onResume() override { ++counts.resumeCount; }
+};
+
+// pops itself, and pushes a state that it pops again, in its update
+struct PoppingState : public TestGame::State
+{
+    explicit PoppingState(StateCounts& pushedCounts) : pushedCounts(pushedCounts) { }
+
+    StateCounts& pushedCounts;
+
+private:
+
+    virtual void update(pine::Seconds deltaTime) override
+    {
+        TestGame::StateStack& stack = getGame().getStateStack();
+        stack.pop();
+        stack.push(new CountingState(pushedCounts));
+        stack.pop();
+    }
+};
+
+static void testDeferredChangesAreCoalesced()
+{
+    const char* test = "stack/deferred_changes_are_coalesced";
+
+    TestGame game;
+    RecordingListener listener;
+    StateCounts bottomCounts;
+    StateCounts pushedCounts;
+    pine::GameStateHandle bottom = game.getStateStack().push(new CountingState(bottomCounts));
+    pine::GameStateHandle popping = game.getStateStack().push(new PoppingState(pushedCounts));
+    game.getStateStack().addListener(&listener);
+    bottomCounts = StateCounts();
+
+    game.update(1.0 / 60);
+    check(listener.calls == "pop ", test, "a deferred pop is reported as a pop, a state pushed and popped again is not reported");
+    check(pushedCounts.initCount == 0, test, "a state pushed and popped again is never started");
+    check(bottomCounts.pauseCount == 0 && bottomCounts.resumeCount == 1, test, "the state below is resumed once");
+    check(game.getStateStack().isOnStack(bottom) && !game.getStateStack().isAlive(popping), test, "only the bottom state is left");
+
+    game.getStateStack().removeListener(&listener);
+    std::cout << test << '\n';
+}
+
+// takes far longer to render a frame than to update
+struct SlowRenderingGame : pine::StatedGame<SlowRenderingGame>
+{
+    void onConfigureEngine() { }
+    void onInit(int argc, char* argv[]) { }
+    void onFrameStart() { }
+    void onUpdate(pine::Seconds deltaTime) { }
+    void onFrameEnd(pine::Real interpolation) { std::this_thread::sleep_for(std::chrono::milliseconds(4)); }
+    void onWillQuit(int errorCode) { }
+};
+
+static void testHostedTickTimeExcludesRendering()
+{
+    const char* test = "host/tick_time_excludes_rendering";
+
+    pine::GameHost<SlowRenderingGame> host(1, 1);
+    pine::GameInstanceId id = host.add();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    pine::GameInstanceStats stats;
+    check(host.getStats(id, stats), test, "the instance has statistics");
+    check(stats.tickCount > 0 && stats.frameCount > 0, test, "the instance has run");
+    check(stats.averageFrameTime() >= 4000000, test, "a frame includes rendering");
+    check(stats.averageTickTime() < 2000000, test, "a tick does not include rendering");
+    std::cout << test << '\n';
+}
+
+static void testJobSystemRunsJobsInOrder()
+{
+    const char* test = "jobs/dependencies_and_lazy_threads";
+
+    pine::JobSystem jobs(2);
+    check(!jobs.hasStartedThreads(), test, "no thread is started before a job is scheduled");
+
+    // reuses the pooled jobs across frames
+    for(int frame = 0; frame < 3; ++frame)
+    {
+        std::atomic<int> first(0);
+        std::atomic<int> sum(0);
+        pine::JobHandle a = jobs.schedule([&first]() { first = 1; });
+        pine::JobHandle b = jobs.parallelFor(0, 100, 7, [&sum, &first](std::size_t i) { sum += first.load() * static_cast<int>(i); }, {a});
+        jobs.wait(b);
+        check(sum == 4950, test, "the loop is run after the job it depends on");
+        jobs.waitForFrame();
+    }
+    check(jobs.hasStartedThreads(), test, "the threads are started by the first job");
+
+    bool threw = false;
+    jobs.schedule([]() { throw std::runtime_error("failed job"); });
+    try
+    {
+        jobs.waitForFrame();
+    }
+    catch(const std::runtime_error&)
+    {
+        threw = true;
+    }
+    check(threw, test, "a job's exception is re-thrown");
+    std::cout << test << '\n';
+}
+
+static void testStateAllocatorsReuseMemory()
+{
+    const char* test = "allocators/reuse_memory";
+
+    // declared before the game, as it must outlive the states it allocates
+    pine::PoolStateAllocator pool(4);
+    {
+        TestGame game;
+        game.getStateStack().setAllocator(&pool);
+        for(int i = 0; i < 3; ++i)
+        {
+            game.getStateStack().push<CountingRollbackState>();
+            game.getStateStack().pop();
+        }
+
+        check(pool.getStats().allocationCount == 3 && pool.getStats().liveCount == 0, test, "the pool allocates each pushed state");
+        check(pool.getPoolStats().size() == 1 && pool.getPoolStats()[0].blockCount == 4, test, "a popped state's block is reused");
+        check(pool.getPoolStats()[0].freeCount == 4, test, "every block is free once the states are destroyed");
+    }
+
+    pine::ArenaStateAllocator arena(256);
+    void* a = arena.allocate(32, alignof(std::max_align_t));
+    std::size_t usedByA = arena.getUsedBytes();
+    void* b = arena.allocate(32, alignof(std::max_align_t));
+    void* c = arena.allocate(32, alignof(std::max_align_t));
+    check(a < b && b < c, test, "the arena allocates upwards");
+
+    arena.deallocate(b, 32, alignof(std::max_align_t));
+    check(arena.getUsedBytes() > usedByA, test, "memory below a live block is not reclaimed");
+    arena.deallocate(c, 32, alignof(std::max_align_t));
+    check(arena.getUsedBytes() == usedByA, test, "free blocks on the top of the arena are reclaimed");
+
+    void* large = arena.allocate(512, alignof(std::max_align_t));
+    check(arena.getStats().heapFallbackCount == 1, test, "an allocation the arena cannot fit falls back to the heap");
+    arena.deallocate(large, 512, alignof(std::max_align_t));
+    arena.deallocate(a, 32, alignof(std::max_align_t));
+    check(arena.getUsedBytes() == 0 && arena.getStats().liveCount == 0, test, "the arena is empty once everything is deallocated");
+    std::cout << test << '\n';
+}
+
+// a level whose resources are kept loaded whilst it is cached
+struct CachedLevelState : public TestGame::State
+{
+private:
+
+    virtual std::size_t getResourceSize() const override { return 100; }
+};
+
+// pushes a cached level, and pops it into the cache
+static void visitLevel(TestGame::StateStack& stack, const char* key)
+{
+    stack.pushCachedWithKey<CachedLevelState>(key);
+    stack.pop();
+}
+
+static void testCacheEvictsLeastRecentlyUsed()
+{
+    const char* test = "cache/evicts_least_recently_used";
+
+    TestGame game;
+    TestGame::StateStack& stack = game.getStateStack();
+    stack.setCacheBudget(2);
+
+    visitLevel(stack, "a");
+    visitLevel(stack, "b");
+    visitLevel(stack, "a");
+    check(stack.getCacheStats().hitCount == 1 && stack.getCacheStats().missCount == 2, test, "a cached level is revived");
+
+    // b is the least recently used
+    visitLevel(stack, "c");
+    check(stack.getCachedCount() == 2 && stack.getCacheStats().evictionCount == 1, test, "the cache is kept within its count");
+
+    visitLevel(stack, "a");
+    check(stack.getCacheStats().hitCount == 2, test, "the recently used level is kept");
+    visitLevel(stack, "b");
+    check(stack.getCacheStats().missCount == 4, test, "the least recently used level is evicted");
+
+    stack.clearCache();
+    stack.setCacheBudget(8, 250);
+    visitLevel(stack, "a");
+    visitLevel(stack, "b");
+    visitLevel(stack, "c");
+    check(stack.getCachedCount() == 2 && stack.getCachedSize() == 200, test, "the cache is kept within its size");
+    std::cout << test << '\n';
+}
+
+struct StaticCountingState;
+struct StaticPoppingState;
+typedef pine::StaticGameStateStack<TestGame, StaticCountingState, StaticPoppingState> StaticStack;
+
+struct StaticStateCounts
+{
+    StaticStateCounts() : updateCount(0), pauseCount(0), resumeCount(0), destroyCount(0) { }
+
+    int updateCount;
+    int pauseCount;
+    int resumeCount;
+    int destroyCount;
+};
+
+// counts what its static stack calls on it
+struct StaticCountingState : pine::StaticGameState<TestGame>
+{
+    explicit StaticCountingState(StaticStateCounts& counts) : counts(counts) { }
+    ~StaticCountingState() { ++counts.destroyCount; }
+
+    void update(pine::Seconds deltaTime) { ++counts.updateCount; }
+    void onPause() { ++counts.pauseCount; }
+    void onResume() { ++counts.resumeCount; }
+
+    StaticStateCounts& counts;
+};
+
+// removes itself from its static stack on its first update
+struct StaticPoppingState : pine::StaticGameState<TestGame>
+{
+    explicit StaticPoppingState(StaticStack& stack) : stack(stack) { }
+
+    void update(pine::Seconds deltaTime) { stack.remove(this); }
+
+    StaticStack& stack;
+};
+
+static void testStaticStackDefersChanges()
+{
+    const char* test = "static_stack/defers_changes";
+
+    TestGame game;
+    StaticStateCounts counts;
+    {
+        StaticStack stack(game, 2);
+        stack.push<StaticCountingState>(counts);
+        stack.push<StaticPoppingState, pine::PushType::PushWithoutPoppingSilenty>(stack);
+        check(counts.pauseCount == 0, test, "a silent push does not pause the state below");
+
+        stack.update(1.0 / 60);
+        check(counts.updateCount == 1, test, "the state below a silent push is updated");
+        check(stack.size() == 1 && !stack.hasPendingChanges(), test, "a state removed whilst updating is removed after the update");
+
+        stack.push<StaticCountingState>(counts);
+        bool threw = false;
+        try
+        {
+            stack.push<StaticCountingState>(counts);
+        }
+        catch(const std::length_error&)
+        {
+            threw = true;
+        }
+        check(threw, test, "pushing more states than the capacity throws");
+        check(counts.pauseCount == 1, test, "a push pauses the state below");
+
+        stack.pop();
+        check(counts.resumeCount == 3 && counts.destroyCount == 1, test, "a pop destroys the top and resumes the state below");
+    }
+    check(counts.destroyCount == 2, test, "the states are destroyed with the stack");
+    std::cout << test << '\n';
+}
+
+// writes a frame into a pipeline
+static void produceFrame(pine::RenderPipeline& pipeline, pine::Real interpolation)
+{
+    std::size_t slot;
+    if(pipeline.beginProduce(slot)) pipeline.endProduce(slot, interpolation);
+}
+
+static void testRenderPipelineDropsAndWaits()
+{
+    const char* test = "pipeline/drops_and_waits";
+
+    std::size_t slot;
+    pine::Real interpolation;
+    {
+        // triple buffered, the simulation never waits
+        pine::RenderPipeline pipeline(3);
+        for(int i = 1; i <= 3; ++i) produceFrame(pipeline, i * pine::Real(0.25));
+        check(pipeline.getStats().droppedCount == 2, test, "a frame that is not rendered before a newer frame is ready is dropped");
+
+        check(pipeline.beginConsume(slot, interpolation) && interpolation == pine::Real(0.75), test, "the newest frame is rendered");
+        pipeline.endConsume(slot);
+    }
+
+    {
+        // double buffered, the simulation waits once it is a frame ahead
+        pine::RenderPipeline pipeline(2);
+        produceFrame(pipeline, 0);
+        check(pipeline.beginConsume(slot, interpolation), test, "a frame is rendered");
+        produceFrame(pipeline, 0);
+
+        std::atomic<bool> hasProduced(false);
+        std::thread producer([&pipeline, &hasProduced]()
+        {
+            produceFrame(pipeline, 0);
+            hasProduced = true;
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        check(!hasProduced, test, "the simulation waits whilst both buffers are in use");
+
+        pipeline.endConsume(slot);
+        producer.join();
+        check(hasProduced && pipeline.getStats().droppedCount == 1, test, "the simulation continues once a frame has been rendered");
+    }
+
+    {
+        pine::RenderPipeline pipeline(2);
+        std::thread consumer([&pipeline]() { pipeline.stop(); });
+        check(!pipeline.beginConsume(slot, interpolation), test, "a stopped pipeline wakes the render thread");
+        consumer.join();
+    }
+    std::cout << test << '\n';
+}
+
+// records the delta time of each update, for a loop policy
+struct SteppedGame
+{
+    void update(pine::Seconds deltaTime) { steps.push_back(deltaTime); }
+    pine::GameLoad& getLoad() { return load; }
+
+    std::vector<pine::Seconds> steps;
+    pine::GameLoad load;
+};
+
+// 10 steps a second, at most 2 a frame, with a second of backlog
+template <pine::OverloadPolicy Policy>
+using TestTimeStep = pine::GovernedTimeStep<10, 2, Policy, std::ratio<1> >;
+
+static bool isNear(pine::Seconds a, pine::Seconds b)
+{
+    return a - b < 1e-9 && b - a < 1e-9;
+}
+
+static void testGovernedTimeStepPolicies()
+{
+    const char* test = "loop/governed_time_step_policies";
+    const pine::Nanoseconds halfSecond = 500000000;
+
+    {
+        SteppedGame game;
+        TestTimeStep<pine::OverloadPolicy::Drop> loop;
+        loop.advance(game, halfSecond);
+        check(game.steps.size() == 2 && isNear(game.steps[0], 0.1), test, "drop runs the most substeps, with the time step");
+        check(game.load.getLastFrame().droppedSteps == 3 && game.load.getLastFrame().backlog == 0, test, "drop skips the other steps");
+        check(game.load.isUnderLoad(), test, "an overloaded frame puts the game under load");
+
+        game.load.setRecoveryFrameCount(2);
+        loop.advance(game, 0);
+        check(game.load.isUnderLoad(), test, "the game stays under load until it has recovered");
+        loop.advance(game, 0);
+        check(!game.load.isUnderLoad(), test, "the game recovers after frames that are not overloaded");
+    }
+
+    {
+        SteppedGame game;
+        TestTimeStep<pine::OverloadPolicy::Dilate> loop;
+        loop.advance(game, halfSecond);
+        check(game.steps.size() == 2 && game.load.getLastFrame().droppedSteps == 0, test, "dilate runs the most substeps, and drops nothing");
+        check(game.load.getLastFrame().backlog == 300000000, test, "dilate carries the other steps over");
+
+        loop.advance(game, 0);
+        loop.advance(game, 0);
+        check(game.steps.size() == 5 && !game.load.getLastFrame().isOverloaded, test, "dilate catches up with the backlog");
+    }
+
+    {
+        SteppedGame game;
+        TestTimeStep<pine::OverloadPolicy::Degrade> loop;
+        loop.advance(game, halfSecond);
+        check(game.steps.size() == 2 && isNear(game.steps[0], 0.3) && isNear(game.steps[1], 0.2), test, "degrade merges the steps into the substeps");
+        check(game.load.getLastFrame().mergedSteps == 3 && game.load.getLastFrame().backlog == 0, test, "degrade keeps up with real time");
+    }
+    std::cout << test << '\n';
+}
+
+static void testTickLogRoundTrip()
+{
+    const char* test = "ticklog/round_trip";
+    const char* path = "pine_tests_round_trip.pinelog";
+
+    {
+        // a small capacity, so the file is grown whilst recording
+        pine::TickLog log;
+        check(log.record(path, 64), test, "the log is created");
+        for(int tick = 0; tick < 100; ++tick)
+        {
+            log.beginTick(1.0 / 60);
+            log.input(&tick, sizeof(tick));
+            if(tick % 10 == 0) log.transition(pine::StackTransition::Push, "LevelState");
+            log.endFrame(pine::Real(0.5));
+        }
+        check(log.getTickCount() == 100, test, "every tick is recorded");
+    }
+
+    {
+        pine::TickLog log;
+        check(log.replay(path), test, "the log is opened");
+
+        int tickCount = 0;
+        int frameCount = 0;
+        bool isIntact = true;
+        pine::TickLogStep step;
+        while(log.readStep(step))
+        {
+            if(step.type == pine::TickLogStep::Type::FrameEnd)
+            {
+                isIntact = isIntact && step.interpolation == pine::Real(0.5);
+                ++frameCount;
+                continue;
+            }
+
+            int input = -1;
+            log.input(&input, sizeof(input));
+            isIntact = isIntact && input == tickCount && step.deltaTime == pine::Seconds(1.0 / 60);
+            if(tickCount % 10 == 0) log.transition(pine::StackTransition::Push, "LevelState");
+            ++tickCount;
+        }
+        check(tickCount == 100 && frameCount == 100, test, "every tick and frame is replayed");
+        check(isIntact, test, "the replayed inputs are the recorded ones");
+        check(!log.hasDiverged(), test, "a faithful replay does not diverge");
+    }
+
+    {
+        pine::TickLog log;
+        log.replay(path);
+
+        // the first tick is replayed as it was recorded, the second pops a state it did not
+        pine::TickLogStep step;
+        int input;
+        log.readStep(step);
+        log.input(&input, sizeof(input));
+        log.transition(pine::StackTransition::Push, "LevelState");
+        log.readStep(step);
+        check(!log.hasDiverged(), test, "the replay has not diverged yet");
+
+        log.readStep(step);
+        log.input(&input, sizeof(input));
+        log.transition(pine::StackTransition::Pop, "");
+        check(log.hasDiverged() && log.getDivergedTick() == 1, test, "the first tick that differs is reported");
+    }
+
+    std::remove(path);
+    std::cout << test << '\n';
+}
+
+static void testTimerWheelCascades()
+{
+    const char* test = "timers/cascade_between_wheels";
+
+    pine::TimerWheel timers;
+    const pine::Tick delays[] = { 1, 255, 256, 257, 511, 65535, 65536, 65536 + 3, 70000 };
+    std::vector<pine::Tick> fired(sizeof(delays) / sizeof(delays[0]), 0);
+    for(std::size_t i = 0; i < fired.size(); ++i)
+    {
+        pine::Tick* firedTick = &fired[i];
+        timers.after(delays[i], [firedTick, &timers]() { *firedTick = timers.getTick(); });
+    }
+
+    std::vector<pine::Tick> repeats;
+    pine::TimerHandle repeating = timers.every(300, [&repeats, &timers]() { repeats.push_back(timers.getTick()); });
+
+    for(pine::Tick tick = 0; tick < 70001; ++tick) timers.advance(1.0 / 60);
+
+    bool isOnTime = true;
+    for(std::size_t i = 0; i < fired.size(); ++i)
+    {
+        isOnTime = isOnTime && fired[i] == delays[i];
+    }
+    check(isOnTime, test, "each timer fires on the tick it is due, from any wheel");
+    check(repeats.size() == 233 && repeats.front() == 300 && repeats.back() == 69900, test, "a repeating timer fires every period");
+    check(timers.getTimerCount() == 1 && timers.cancel(repeating) && timers.getTimerCount() == 0, test, "only the repeating timer is left");
+
+    // timers cancelled whilst in an outer wheel never fire
+    int owner = 0;
+    int fireCount = 0;
+    pine::TimerHandle cancelled = timers.after(300, [&fireCount]() { ++fireCount; });
+    timers.after(70000, [&fireCount]() { ++fireCount; }, &owner);
+    timers.every(1000, [&fireCount]() { ++fireCount; }, &owner);
+    timers.after(300, [&fireCount]() { fireCount += 100; });
+    check(timers.cancel(cancelled) && !timers.cancel(cancelled), test, "a timer is cancelled once");
+    timers.cancelAll(&owner);
+    check(timers.getTimerCount() == 1, test, "cancelAll cancels every timer of an owner");
+    for(pine::Tick tick = 0; tick < 70001; ++tick) timers.advance(1.0 / 60);
+    check(fireCount == 100 && timers.getTimerCount() == 0, test, "only the timer left fires");
+    std::cout << test << '\n';
+}
+
+static void testEventQueueOverflow()
+{
+    const char* test = "events/queue_overflow";
+
+    pine::EventQueue queue(3);
+    check(queue.getCapacity() == 4, test, "the capacity is rounded up to a power of two");
+
+    // wraps around the ring a few times, filling it past its capacity each time
+    bool isInOrder = true;
+    bool isDroppingWhenFull = true;
+    for(int round = 0; round < 3; ++round)
+    {
+        for(int i = 0; i < 4; ++i)
+        {
+            isDroppingWhenFull = isDroppingWhenFull && queue.post(1, round * 10 + i);
+        }
+        isDroppingWhenFull = isDroppingWhenFull && !queue.post(1, -1) && !queue.post(1, -1);
+        isDroppingWhenFull = isDroppingWhenFull && queue.getPendingCount() == 4;
+
+        pine::GameEvent event;
+        for(int i = 0; i < 4; ++i)
+        {
+            isInOrder = isInOrder && queue.take(event) && event.getData<int>() == round * 10 + i;
+        }
+        isInOrder = isInOrder && !queue.take(event) && queue.getPendingCount() == 0;
+    }
+
+    check(isDroppingWhenFull, test, "posting to a full queue drops the event");
+    check(queue.getDroppedCount() == 6, test, "every dropped event is counted");
+    check(isInOrder, test, "events are taken in the order they were posted, and the queue is usable again once taken");
+    std::cout << test << '\n';
+}
+
+static void testHandlesAreNotReused()
+{
+    const char* test = "stack/handles_are_not_reused";
+
+    TestGame game;
+    TestGame::StateStack& stack = game.getStateStack();
+    StateCounts counts = {};
+    CountingState* bottom = new CountingState(counts);
+    stack.push(bottom);
+
+    pine::GameStateHandle oldHandle = stack.push<CountingState>(counts);
+    stack.remove(oldHandle);
+
+    CountingState* state = new CountingState(counts);
+    pine::GameStateHandle newHandle = stack.push(state);
+    check(newHandle.index == oldHandle.index && newHandle.generation != oldHandle.generation, test, "the slot of a removed state is reused");
+    check(!stack.isAlive(oldHandle) && stack.get(oldHandle) == nullptr, test, "the old handle no longer refers to a state");
+    check(stack.isAlive(newHandle) && stack.get(newHandle) == state, test, "the new handle refers to the new state");
+
+    check(!stack.remove(oldHandle), test, "removing with the old handle does nothing");
+    check(stack.isOnStack(newHandle) && stack.get(newHandle) == state, test, "the new state is left on the stack");
+
+    check(stack.remove(newHandle) && !stack.isAlive(newHandle), test, "the new handle removes the new state");
+    check(stack.get(oldHandle) == nullptr && stack.get(newHandle) == nullptr, test, "neither handle refers to a state");
+    std::cout << test << '\n';
+}
+
+int main()
+{
+    testFailedAsyncLoadReleasesHandle();
+    testRollbackRewindsTimers();
+    testRollbackRestoresRemovedStates();
+    testRollbackIsNotRecorded();
+    testEventsAreRoutedOnce();
+    testSleepingStateIsNotUpdated();
+    testIndependentStatesAreUpdated();
+    testProfileBuffersAreRecycled();
+    testProfilerExportsWhilstRecording();
+    testDeferredChangesAreCoalesced();
+    testHostedTickTimeExcludesRendering();
+    testJobSystemRunsJobsInOrder();
+    testStateAllocatorsReuseMemory();
+    testCacheEvictsLeastRecentlyUsed();
+    testStaticStackDefersChanges();
+    testRenderPipelineDropsAndWaits();
+    testGovernedTimeStepPolicies();
+    testTickLogRoundTrip();
+    testTimerWheelCascades();
+    testEventQueueOverflow();
+    testHandlesAreNotReused();
+
+    std::cout << (failureCount == 0 ? "all tests passed" : "some tests failed") << '\n';
+    return failureCount == 0 ? 0 : 1;
+}